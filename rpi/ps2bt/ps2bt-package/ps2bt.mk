@@ -10,7 +10,7 @@ PS2BT_SITE_METHOD = local
 PS2BT_LICENSE = GPLv2+
 
 define PS2BT_BUILD_CMDS
-	$(MAKE) CC="$(TARGET_CC)" -C $(@D)
+	$(MAKE) CC="$(TARGET_CC)" HOSTCC="$(HOSTCC)" -C $(@D)
 endef
 
 define PS2BT_INSTALL_TARGET_CMDS
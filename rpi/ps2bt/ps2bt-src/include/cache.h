@@ -0,0 +1,64 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cfg.h"
+
+#define CFG_CACHE_MAGIC   "ps2bcfg" /* Seven characters and the terminator */
+#define CFG_CACHE_VERSION 1         /* Increment whenever cfg_settings changes */
+
+/* Identifies the contents of a settings file without reading it
+	- A missing file has every field set to -1 */
+typedef struct
+{
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+} cfg_cache_stamp;
+
+/* Compiled settings
+	- cfg_settings exactly as cfg_file_read() left it, with the custom mapping already
+	  resolved to input offsets, so loading is a single mapped page and a copy
+	- Valid only while both settings files still match their stamps
+	- The file is only ever read by the build that wrote it so the layout is native */
+typedef struct
+{
+	char            magic[8];
+	uint32_t        version;
+	uint32_t        length;     /* sizeof(cfg_settings) */
+	uint32_t        crc;        /* CRC-32 of everything from sources on */
+	uint32_t        reserved;
+	cfg_cache_stamp sources[2]; /* RO then RW settings file */
+	cfg_settings    settings;
+} cfg_cache;
+
+uint32_t cfg_cache_crc(const void *data, size_t length);
+void     cfg_cache_stamp_file(const char *path, cfg_cache_stamp *stamp);
+/* 0 - settings copied from the cache
+  -1 - cache missing, damaged, from another version or older than the settings files */
+int      cfg_cache_read(const char *cache_path, const cfg_cache_stamp *sources, cfg_settings *settings);
+/* 0 - success
+  -1 - failed to write the cache - the previous one, if any, is left in place */
+int      cfg_cache_write(const char *cache_path, const cfg_cache_stamp *sources, const cfg_settings *settings);
+/* Loads settings from the cache, or parses the settings files and rewrites the cache when
+   either file has changed since it was written */
+void     cfg_cache_load(const char *ro_path, const char *rw_path, const char *cache_path, cfg_settings *settings);
+
+#endif
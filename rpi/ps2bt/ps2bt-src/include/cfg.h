@@ -24,6 +24,8 @@
 typedef struct {
 	uint8_t        default_pressure;
 	uint8_t        analog_to_button_deadzone;
+	unsigned int   frame_sync;
+	unsigned int   frame_sync_guard;
 	unsigned int   ds3_leds[2];
 	uint8_t        ds4_leds[3];
 	uint8_t        ds4_triangle_pressure;
@@ -36,6 +38,9 @@ typedef struct {
 } cfg_settings;
 
 void cfg_file_read(const char *ro_path, const char *rw_path, cfg_settings *settings);
-void cfg_file_write(const char *rw_path, cfg_settings *settings);
+/* Applies the [custom_mapping.<address>] section of the controller with that address
+   ("aa:bb:cc:dd:ee:ff") over the custom mapping already in settings */
+void cfg_file_read_address(const char *ro_path, const char *address, cfg_settings *settings);
+void cfg_file_write(const char *rw_path, const cfg_settings *settings);
 
 #endif
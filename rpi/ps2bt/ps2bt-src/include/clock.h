@@ -0,0 +1,34 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/* All time used by ps2bt goes through here
+	- Times are nanoseconds on CLOCK_MONOTONIC
+	- The virtual clock only moves when something sleeps, which makes a replayed
+	  session deterministic and lets it run as fast as the pipeline allows */
+#define CLOCK_VIRTUAL_START ((int64_t)1000000000) /* Timers treat zero as unset */
+
+void    clock_use_virtual(int64_t start);
+int64_t clock_now(void);
+int64_t clock_real(void); /* Always CLOCK_MONOTONIC - for measuring ps2bt itself */
+void    clock_sleep_until(int64_t time);
+void    clock_sleep(int64_t duration);
+
+#endif
@@ -17,6 +17,7 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct
@@ -68,6 +69,14 @@ extern const char *controller_map_offset_to_string[24];
 extern uint16_t    controller_map_offset_to_buffer[24];
 extern uint16_t    controller_map_offset_to_bitmask[16];
 
+/* Control name hash - shared by the table generator in tools/genhash.c and the lookup */
+#define CONTROLLER_HASH_STEP(hash, c)    ((((hash) ^ (uint8_t)(c)) * 16777619U) & 0xFFFFFFFFU)
+#define CONTROLLER_HASH_SLOT(hash, mask) ((((hash) >> 16) ^ (hash)) & (mask))
+
+/* Offset of the control named by length characters of text or -1 when there is none
+	- One probe of a perfect hash table generated at build time and one comparison */
+int controller_map_string_to_offset(const char *text, size_t length);
+
 void controller_remap(controller_inputs *in, controller_inputs *out, controller_map *map,
                       uint8_t default_pressure, uint8_t deadzone);
 
@@ -31,28 +31,98 @@ typedef enum {
 	INI_ERROR_NO_DEFINITIONS = -6
 } ini_error;
 
+#ifndef INI_VIEW_MAX_KEYS
+#define INI_VIEW_MAX_KEYS 256 /* Keys an ini_view_file holds without allocating - a power of two, can be set at build time */
+#endif
+
 struct ini_key
 {
 	char           *section;
 	char           *key;
 	char           *value;
 	struct ini_key *next;
+	unsigned int    hash;  /* Hash of section and key */
+	unsigned int    order; /* Position in the list */
 	char            storage[1];
 };
 
 typedef struct ini_key ini_key;
 
+/* Arena blocks - keys are allocated one after another and all blocks are freed together */
+struct ini_arena
+{
+	struct ini_arena *next;
+	size_t            size;
+	size_t            used;
+	char             *storage;
+};
+
+typedef struct ini_arena ini_arena;
+
+/* Keys are kept in order in a list and indexed by an open addressing hash table
+	- The index holds the first key for each section and key so duplicates keep
+	  resolving to the first definition
+	- Keys without a section (before the first section header) match any section */
 typedef struct 
 {
-	ini_key *head;
-	ini_key *tail;
+	ini_key      *head;
+	ini_key      *tail;
+	ini_key     **index;
+	unsigned int  index_size; /* Slots - zero or a power of two */
+	unsigned int  index_used;
+	unsigned int  count;
+	ini_arena    *arena;
 } ini_key_list;
 
+/* Text inside a mapped file - not terminated */
+typedef struct
+{
+	const char  *text;
+	unsigned int length;
+} ini_view;
+
+typedef struct
+{
+	ini_view     section; /* text is NULL for keys before the first section header */
+	ini_view     key;
+	ini_view     value;
+	unsigned int hash;
+} ini_view_key;
+
+/* Zero-copy parse mode
+	- The file is mapped and every section, key and value is a view into the mapping
+	  so opening a file copies nothing
+	- Keys are indexed the same way as an ini_key_list in a table inside the structure, which
+	  is only outgrown, and the keys and table allocated, by a file of more than
+	  INI_VIEW_MAX_KEYS keys
+	- Values are only converted when they are looked up */
+typedef struct
+{
+	const char   *map;
+	size_t        size;
+	unsigned int  count;
+	unsigned int  capacity;
+	ini_view_key *keys;                               /* Every key in file order including redefinitions */
+	unsigned int *index;                              /* Key number + 1 of the first definition - zero when
+	                                                     empty - capacity * 2 slots */
+	ini_view_key  local_keys[INI_VIEW_MAX_KEYS];      /* keys and index until the file outgrows them */
+	unsigned int  local_index[INI_VIEW_MAX_KEYS * 2];
+} ini_view_file;
+
 ini_error ini_key_list_insert(ini_key_list *list, const char *section, const char *key, const char *value);
 void      ini_key_list_empty(ini_key_list *list);
 ini_key  *ini_key_list_search(ini_key_list *list, const char *section, const char *key);
 ini_error ini_read(const char *path, ini_key_list *list);
 ini_error ini_write(const char *path, ini_key_list *list);
+/* Syncs the directory holding path so a file just renamed to path survives a power cut */
+ini_error ini_sync_directory(const char *path);
 void      ini_print(ini_key_list *list);
 
+ini_error       ini_view_open(const char *path, ini_view_file *file);
+void            ini_view_close(ini_view_file *file);
+const ini_view *ini_view_search(ini_view_file *file, const char *section, const char *key);
+int             ini_view_equals(const ini_view *view, const char *text);
+long            ini_view_long(const ini_view *view);     /* Same result as atoi() on the text */
+double          ini_view_double(const ini_view *view);   /* Same result as atof() on the text */
+
 #endif
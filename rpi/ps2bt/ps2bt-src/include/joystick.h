@@ -20,6 +20,10 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <linux/joystick.h>
+#include "trace.h"
+#include "stats.h"
+
+#define JOYSTICK_BATCH_MAX 64 /* Events published to the frame loop at once */
 
 typedef struct
 {
@@ -57,6 +61,11 @@ typedef struct
 	pthread_mutex_t inputs_mutex;
 	pthread_t       thread;
 	unsigned int    thread_terminated;
+	trace           trace; /* Recording of the events the frames observed - file is NULL when not recording */
+	stats_set       stats; /* Timings of the polling thread */
+	
+	unsigned int has_address; /* Set when the controller is connected over Bluetooth */
+	uint8_t      address[6];
 	
 	unsigned int led_support;
 	int          led_devices[4];
@@ -67,6 +76,9 @@ typedef struct
 	struct ff_effect rumble_motors;
 } joystick;
 
-int joystick_init(const char *joystick_path, const char *event_path, joystick *js);
+/* trace_path may be NULL - otherwise the consumed input is recorded there */
+int  joystick_init(const char *joystick_path, const char *event_path, const char *trace_path, joystick *js);
+void joystick_init_inputs(unsigned int type, joystick_inputs *inputs);
+void joystick_decode_event(unsigned int type, joystick_inputs *inputs, const struct js_event *event);
 
 #endif
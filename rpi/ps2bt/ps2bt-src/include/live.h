@@ -0,0 +1,71 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdint.h>
+#include "controller.h"
+#include "joystick.h"
+#include "serial.h"
+
+#ifndef LIVE_FILE
+#define LIVE_FILE "/dev/shm/ps2bt"
+#endif
+
+/* Live state shared with monitors through a file in /dev/shm (native byte order)
+	- ps2bt publishes every frame with a memcpy between two sequence increments (a seqlock)
+	  so publishing never makes a system call or waits for a reader
+	- The sequence is odd while the data is being written, a reader copies the data and
+	  retries when the sequence was odd or has changed since it started */
+#define LIVE_MAGIC   "ps2blive"
+#define LIVE_VERSION 1
+
+typedef struct
+{
+	uint32_t          type;          /* Dualshock type (3 or 4) */
+	uint32_t          sync_locked;   /* Non-zero when frame_sync is tracking the console */
+	uint64_t          frames;
+	uint64_t          replies;       /* Replies received from the Teensy */
+	uint64_t          timeouts;      /* Frames without a reply */
+	int64_t           time;          /* Frame time - nanoseconds on CLOCK_MONOTONIC */
+	int64_t           sync_period;   /* Estimated console poll period - zero if unknown */
+	int64_t           sync_error;    /* Filtered phase error */
+	joystick_inputs   joystick;      /* Inputs sampled by the frame */
+	controller_inputs controller;    /* The same inputs after the handlers and remapping */
+	uint8_t           packet[SEND_PACKET_SIZE];
+	uint8_t           reply[RECV_PACKET_SIZE]; /* Last reply - all zero before the first */
+} live_data;
+
+typedef struct
+{
+	char              magic[8];
+	uint32_t          version;
+	uint32_t          size;          /* sizeof(live_state) of the writer */
+	volatile uint32_t sequence;
+	uint32_t          reserved;
+	live_data         data;
+} live_state;
+
+/* NULL on error */
+live_state *live_create(const char *path);
+live_state *live_open(const char *path);
+void        live_publish(live_state *state, const live_data *data);
+/*  0 - data holds a consistent copy
+	-1 - ps2bt kept writing for every attempt */
+int         live_read(live_state *state, live_data *data);
+
+#endif
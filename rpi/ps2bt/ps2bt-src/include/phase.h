@@ -0,0 +1,48 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdint.h>
+#include "serial.h"
+
+/* All times are CLOCK_MONOTONIC nanoseconds */
+typedef struct
+{
+	unsigned int locked;        /* Non-zero when the console's period and phase are being tracked */
+	unsigned int lock_count;    /* Consecutive observations within tolerance */
+	unsigned int miss_count;    /* Consecutive observations outside of tolerance */
+	
+	unsigned int have_reply;    /* Non-zero once the Teensy clock has been sampled */
+	uint16_t     reply_ticks;   /* Teensy timer value when the last packet was composed */
+	int64_t      reply_time;    /* Local time the last packet was received */
+	int64_t      teensy_time;   /* Unwrapped Teensy time of the last packet */
+	int64_t      offset;        /* Lowest observed local time minus Teensy time */
+	
+	unsigned int have_poll;     /* Non-zero once a console poll has been observed */
+	int64_t      last_poll;     /* Local time of the last observed console poll */
+	int64_t      period;        /* Estimated console poll period - zero if unknown */
+	int64_t      phase;         /* Estimated local time of the last console poll */
+	int64_t      error;         /* Phase error of the last observation */
+	int64_t      error_average; /* Filtered magnitude of the phase error */
+} phase_estimator;
+
+void    phase_estimator_init(phase_estimator *est);
+void    phase_estimator_update(phase_estimator *est, int64_t now, uint8_t (*packet)[RECV_PACKET_SIZE]);
+int64_t phase_estimator_schedule(phase_estimator *est, int64_t now, int64_t guard);
+
+#endif
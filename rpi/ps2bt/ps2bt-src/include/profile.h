@@ -0,0 +1,86 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "cache.h"
+
+#define CFG_PROFILE_MAGIC   "ps2bprf" /* Seven characters and the terminator */
+#define CFG_PROFILE_VERSION 2         /* Increment whenever cfg_profile changes */
+#define CFG_PROFILE_SLOTS   64        /* Power of two - controllers one adapter remembers */
+
+/* Compiled settings of one controller
+	- Holds the controller's own LED colors and any [custom_mapping.<address>] section
+	  over the shared settings
+	- Valid while the RO settings file matches source - when that file changes the profile
+	  is compiled again
+	- LED colors saved on the controller are kept apart from the compiled settings so they
+	  are applied again over a new compile - until then they come from the files */
+typedef struct
+{
+	uint8_t         address[6];
+	uint8_t         used;
+	uint8_t         reserved;
+	uint32_t        crc;         /* CRC-32 of everything from source on */
+	cfg_cache_stamp source;
+	uint8_t         ds4_leds[3]; /* Saved on the controller - valid when leds_saved is set */
+	uint8_t         leds_saved;
+	cfg_settings    settings;
+} cfg_profile;
+
+typedef struct
+{
+	char        magic[8];
+	uint32_t    version;
+	uint32_t    length; /* sizeof(cfg_profile) */
+	cfg_profile slots[CFG_PROFILE_SLOTS];
+} cfg_profile_file;
+
+/* Profile store
+	- A fixed size table of profiles hashed by Bluetooth address which stays mapped while
+	  ps2bt runs so finding a profile is one probe into memory in the common case
+	- Profiles are updated in place - a profile torn by a crash fails its CRC and is compiled again
+	- The watcher and writer threads of every pipeline update profiles and share the cache
+	  and RW settings file so every access holds the mutex */
+typedef struct
+{
+	const char       *ro_path;
+	const char       *rw_path;
+	const char       *cache_path;
+	cfg_profile_file *map;
+	pthread_mutex_t   mutex;
+} cfg_profile_store;
+
+/* Creates the store when it is missing or from another version
+	0 - success
+   -1 - failed to open or map the store */
+int  cfg_profile_open(const char *path, const char *ro_path, const char *rw_path, const char *cache_path,
+                      cfg_profile_store *store);
+void cfg_profile_close(cfg_profile_store *store);
+/* Loads the settings of the controller with address
+	- The stored profile is used when it is still valid, otherwise the shared settings are loaded
+	  through the cache, the controller's mapping section is applied and the profile is stored
+	- address is NULL for a controller without one and a store which failed to open still
+	  loads the shared settings */
+void cfg_profile_load(cfg_profile_store *store, const uint8_t *address, cfg_settings *settings);
+/* Stores settings changed while running (LED colors) in the profile of address
+	- Without an address or a store they are written to the RW settings file */
+void cfg_profile_save(cfg_profile_store *store, const uint8_t *address, const cfg_settings *settings);
+
+#endif
@@ -21,12 +21,47 @@
 #include "controller.h"
 
 #define SEND_PACKET_SIZE 20
-#define RECV_PACKET_SIZE 4
+#define RECV_PACKET_SIZE 8
+
+/* Packets and replies start with SERIAL_HEADER plus the multitap slot they are for
+	- Pipelines sharing a Teensy each have their own slot, a lone controller uses slot A */
+#define SERIAL_HEADER 0x5A
+#define SERIAL_SLOTS  4
+
+/* Received packet layout
+	- Byte 0:   Header - SERIAL_HEADER plus the slot
+	- Byte 1:   Small motor
+	- Byte 2:   Large motor
+	- Byte 3:   Footer - 0x55 for mode LED off - 0xAA for mode LED on
+	- Byte 4-5: Teensy timestamp of the last console poll (little-endian, SERIAL_POLL_TICK_NS units)
+	- Byte 6-7: Time elapsed since that poll when the packet was composed (same units) */
+#define SERIAL_POLL_TICK_NS 64000
+
+/* A diagnostics request is answered with footer SERIAL_DIAGNOSTICS_FOOTER and the Teensy's
+   USB receive counters, each capped at 255, in place of the motors
+	- Byte 1: Times its receive ring filled while the USB endpoint still held data
+	- Byte 2: Times the Pi was NAKed as a result */
+#define SERIAL_DIAGNOSTICS_FOOTER 0x3C
+
+/* How long to wait for a reply
+	- The Teensy answers every packet so its reply is waited for through more than a console
+	  frame - one that comes later is discarded before the next packet is sent
+	- A Teensy built with REPLY_ON_CHANGE_ONLY leaves most packets unanswered so the wait
+	  is short and a missing reply means nothing changed */
+#define SERIAL_RECV_TIMEOUT_MS             50
+#define SERIAL_RECV_CHANGE_ONLY_TIMEOUT_MS 2
 
 int  serial_init(const char *serial_path);
 void serial_construct_packet(controller_inputs *inputs, uint8_t (*packet)[SEND_PACKET_SIZE], int mode_switch);
-int  serial_send_packet(int fd, uint8_t (*packet)[SEND_PACKET_SIZE]);
-int  serial_send_disconnect_packet(int fd);
-int  serial_recv_packet(int fd, uint8_t (*packet)[RECV_PACKET_SIZE]);
+/* Sets the header of packet for slot - packets are always constructed for slot A */
+int  serial_send_packet(int fd, unsigned int slot, uint8_t (*packet)[SEND_PACKET_SIZE]);
+int  serial_send_disconnect_packet(int fd, unsigned int slot);
+int  serial_send_diagnostics_packet(int fd, unsigned int slot);
+/*  0 - no reply for slot within timeout_ms (motors and mode LED are unchanged)
+	1 - packet holds the newest reply for slot
+	-1 - error */
+int  serial_recv_packet(int fd, unsigned int slot, uint8_t (*packet)[RECV_PACKET_SIZE], int timeout_ms);
+/* Drops every reply already received - 0 on success, -1 on error */
+int  serial_discard_replies(int fd);
 
 #endif
@@ -0,0 +1,84 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+#ifndef STATS_FILE
+#define STATS_FILE "/run/ps2bt.stats" /* Rewritten every STATS_INTERVAL */
+#endif
+
+#define STATS_INTERVAL ((int64_t)1000000000)
+
+/* Per stage latency histograms
+	- Durations are nanoseconds of real time so they stay meaningful during a fast replay
+	- Buckets are log-linear: exact below 2 * STATS_SUB_BUCKETS and STATS_SUB_BUCKETS
+	  linear buckets for every power of two above, so every value is within 1/16 of its bucket
+	- Durations of STATS_LIMIT and above go in the last bucket
+	- Every thread which records owns a stats_set so recording takes no lock and nothing is
+	  allocated - the writer merges the registered sets, and a snapshot may be off by the
+	  samples recorded while it is taken
+	- The file is written by its own thread so the frame loop never touches the file system */
+#define STATS_SUB_BITS    4
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_SHIFT_MAX   32 /* Largest shift - durations up to 2^36ns (68s) */
+#define STATS_BUCKETS     ((STATS_SHIFT_MAX + 2) * STATS_SUB_BUCKETS)
+#define STATS_LIMIT       ((int64_t)1 << (STATS_SHIFT_MAX + STATS_SUB_BITS))
+
+enum stats_stage
+{
+	STATS_EVENT_READ,   /* read() of one joystick event */
+	STATS_DECODE,       /* Decoding one joystick event */
+	STATS_PUBLISH,      /* Publishing a batch of events to the frame loop */
+	STATS_HANDLER,      /* Interaction and settings handler - without the remap */
+	STATS_REMAP,        /* apply_controller_map() */
+	STATS_PACKET_BUILD, /* Building the serial packet */
+	STATS_SERIAL_WRITE, /* Sending the packet to the Teensy */
+	STATS_REPLY_READ,   /* Waiting for and reading the Teensy's reply */
+	STATS_OUTPUT,       /* Setting the controller's LEDs and rumble */
+	STATS_FRAME,        /* Start of one frame to the start of the next */
+	STATS_STAGES
+};
+
+typedef struct
+{
+	uint64_t counts[STATS_BUCKETS];
+	uint64_t count;
+	uint64_t total;
+	int64_t  min;
+	int64_t  max;
+} stats_histogram;
+
+/* Histograms recorded by one thread */
+typedef struct stats_set
+{
+	stats_histogram   stages[STATS_STAGES];
+	struct stats_set *next; /* Registered sets */
+} stats_set;
+
+/* Starts the thread which rewrites path every STATS_INTERVAL - returns -1 on error */
+int     stats_start(const char *path);
+/* Clears set and adds it to the file - a registered set must stay valid while ps2bt runs */
+void    stats_register(stats_set *set);
+int64_t stats_time(void);
+/* Only the thread owning set may record into it */
+void    stats_record(stats_set *set, unsigned int stage, int64_t duration);
+/* frame_sync state written after the stages */
+void    stats_sync(unsigned int locked, int64_t period, int64_t error);
+
+#endif
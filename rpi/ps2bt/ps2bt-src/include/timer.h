@@ -0,0 +1,53 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Timer wheel for the interaction state machines
+	- Timers are kept in TIMER_WHEEL_SLOTS lists by the tick they expire in
+	  so advancing the wheel only looks at the slots of the ticks that passed
+	- Timers further out than one revolution stay in their slot until their tick comes around
+	- Expired timers are returned one at a time as events and may be restarted from there */
+#define TIMER_WHEEL_SLOTS 64
+#define TIMER_WHEEL_TICK  ((int64_t)10000000) /* 10ms */
+
+typedef struct timer
+{
+	struct timer *next;
+	int64_t       expires; /* Time the timer fires */
+	unsigned int  id;      /* Identifies the event to the owner */
+	unsigned int  armed;   /* Non-zero while the timer is in the wheel */
+	unsigned int  slot;    /* Slot holding the timer while armed */
+} timer;
+
+typedef struct
+{
+	timer  *slots[TIMER_WHEEL_SLOTS];
+	int64_t tick;          /* Next tick to be examined */
+} timer_wheel;
+
+void   timer_wheel_init(timer_wheel *wheel, int64_t now);
+void   timer_init(timer *t, unsigned int id);
+void   timer_start(timer_wheel *wheel, timer *t, int64_t expires);
+void   timer_stop(timer_wheel *wheel, timer *t);
+/* NULL - nothing else has expired by now
+   !NULL - an expired timer which is no longer armed */
+timer *timer_wheel_expire(timer_wheel *wheel, int64_t now);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/joystick.h>
+#include "cfg.h"
+#include "serial.h"
+
+/* Trace file layout (native byte order)
+	- Header: "ps2btrc" (8 bytes with terminator), version, Dualshock type, two reserved bytes
+	- Records: 8 bytes each with the same layout as struct js_event
+		- Joystick events are stored exactly as read with their kernel timestamps
+		- A TRACE_FRAME record marks where a frame sampled the inputs
+			- time:   microseconds since the previous frame
+			- value:  checksum of the serial packet the frame produced
+		- A TRACE_SETTINGS record is followed by a trace_settings with the settings of the
+		  frames after it - written before the first frame and whenever settings are swapped
+		  so a replay runs with the captured settings rather than its own host's */
+#define TRACE_MAGIC    "ps2btrc"
+#define TRACE_VERSION  2
+#define TRACE_FRAME    0x40
+#define TRACE_SETTINGS 0x41
+
+typedef struct js_event trace_record;
+
+typedef struct
+{
+	int64_t      time;     /* Time of the first frame to use settings - the first one starts the UI */
+	cfg_settings settings;
+} trace_settings;
+
+typedef struct
+{
+	FILE        *file;
+	unsigned int type;       /* Dualshock type (3 or 4) */
+	int64_t      last_frame; /* Time of the last frame record - zero before the first */
+} trace;
+
+int      trace_create(const char *path, unsigned int type, trace *t);
+int      trace_open(const char *path, trace *t);
+void     trace_close(trace *t);
+void     trace_write_events(trace *t, const struct js_event *events, unsigned int count);
+void     trace_write_frame(trace *t, int64_t now, uint8_t (*packet)[SEND_PACKET_SIZE]);
+void     trace_write_settings(trace *t, int64_t now, const cfg_settings *settings);
+/*  1 - record holds the next record
+	0 - end of trace
+	-1 - error */
+int      trace_read(trace *t, trace_record *record);
+/* Reads the trace_settings following a TRACE_SETTINGS record
+	0 - success
+	-1 - error or truncated trace */
+int      trace_read_settings(trace *t, trace_settings *settings);
+uint16_t trace_checksum(uint8_t (*packet)[SEND_PACKET_SIZE]);
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <pthread.h>
+#include "profile.h"
+
+#define CFG_WATCH_SETTLE_MS 50 /* Quiet time after the last change before reparsing */
+
+/* Settings hot-reload
+	- A thread watches the directories of both settings files with inotify so files which
+	  are replaced rather than rewritten are still seen
+	- The controller's settings are loaded again on that thread once changes have settled,
+	  which recompiles the cache and its profile as needed, and the result is published
+	  as a single pointer which the frame loop takes ownership of
+	- A result the frame loop has not taken yet is replaced and freed by the watcher */
+typedef struct
+{
+	cfg_profile_store     *profiles; /* Settings file paths and profiles */
+	const uint8_t         *address;  /* Controller's address - NULL without a profile */
+	int                    inotify;
+	pthread_t              thread;
+	cfg_settings *volatile pending;  /* Newest parsed settings - NULL once taken */
+} cfg_watch;
+
+int           cfg_watch_start(cfg_profile_store *profiles, const uint8_t *address, cfg_watch *watch);
+/* NULL - nothing changed since the last call
+   !NULL - newly parsed settings which the caller must free() */
+cfg_settings *cfg_watch_take(cfg_watch *watch);
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <pthread.h>
+#include "profile.h"
+
+#define CFG_WRITER_SETTLE_MS 500 /* Quiet time after the last request before writing */
+
+/* Background settings writer
+	- cfg_writer_request() only copies the settings under a mutex and signals the writer thread
+	  so the frame loop never waits for the file system
+	- Settings go to the controller's profile, or to the RW settings file for a controller without one
+	- Requests are coalesced until none has arrived for CFG_WRITER_SETTLE_MS and only the
+	  newest settings are written */
+typedef struct
+{
+	cfg_profile_store *profiles;
+	const uint8_t     *address;    /* Controller's address - NULL without a profile */
+	pthread_t          thread;
+	pthread_mutex_t    mutex;
+	pthread_cond_t     cond;
+	cfg_settings       settings;   /* Newest requested settings */
+	unsigned int       pending;    /* Non-zero while settings has not been written */
+	unsigned int       generation; /* Incremented by every request */
+	unsigned int       stop;
+} cfg_writer;
+
+int  cfg_writer_start(cfg_profile_store *profiles, const uint8_t *address, cfg_writer *writer);
+void cfg_writer_request(cfg_writer *writer, const cfg_settings *settings);
+/* Writes any pending settings without waiting and stops the writer thread */
+void cfg_writer_stop(cfg_writer *writer);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200809L /* stat.st_mtim, fsync(), mmap() */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "ini.h"
+
+/* Bitwise CRC-32 (IEEE 802.3) - records are a few hundred bytes so a table is not worth it */
+uint32_t cfg_cache_crc(const void *data, size_t length)
+{
+	const uint8_t *bytes = (const uint8_t *)data;
+	uint32_t       crc = 0xFFFFFFFFU;
+	size_t         i;
+	unsigned int   bit;
+	
+	for (i = 0; i < length; i++)
+	{
+		crc ^= bytes[i];
+		
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1)));
+		}
+	}
+	
+	return ~crc;
+}
+
+static uint32_t cfg_cache_checksum(const cfg_cache *cache)
+{
+	return cfg_cache_crc(&cache->sources, sizeof(cfg_cache) - offsetof(cfg_cache, sources));
+}
+
+static int cfg_cache_stamp_equal(const cfg_cache_stamp *a, const cfg_cache_stamp *b)
+{
+	return a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec && a->size == b->size;
+}
+
+void cfg_cache_stamp_file(const char *path, cfg_cache_stamp *stamp)
+{
+	struct stat info;
+	
+	if (stat(path, &info) == -1)
+	{
+		stamp->mtime_sec = -1;
+		stamp->mtime_nsec = -1;
+		stamp->size = -1;
+		return;
+	}
+	
+	stamp->mtime_sec = (int64_t)info.st_mtim.tv_sec;
+	stamp->mtime_nsec = (int64_t)info.st_mtim.tv_nsec;
+	stamp->size = (int64_t)info.st_size;
+}
+
+int cfg_cache_read(const char *cache_path, const cfg_cache_stamp *sources, cfg_settings *settings)
+{
+	const cfg_cache *cache;
+	struct stat      info;
+	void            *map;
+	int              fd;
+	int              valid;
+	
+	if ((fd = open(cache_path, O_RDONLY)) == -1)
+	{
+		return -1;
+	}
+	
+	if (fstat(fd, &info) == -1 || info.st_size != (off_t)sizeof(cfg_cache))
+	{
+		close(fd);
+		return -1;
+	}
+	
+	map = mmap(NULL, sizeof(cfg_cache), PROT_READ, MAP_SHARED, fd, 0);
+	
+	close(fd);
+	
+	if (map == MAP_FAILED)
+	{
+		return -1;
+	}
+	
+	cache = (const cfg_cache *)map;
+	
+	valid = !memcmp(cache->magic, CFG_CACHE_MAGIC, sizeof(cache->magic))
+	&&      cache->version == CFG_CACHE_VERSION
+	&&      cache->length == sizeof(cfg_settings)
+	&&      cfg_cache_stamp_equal(&cache->sources[0], &sources[0])
+	&&      cfg_cache_stamp_equal(&cache->sources[1], &sources[1])
+	&&      cache->crc == cfg_cache_checksum(cache);
+	
+	if (valid)
+	{
+		*settings = cache->settings;
+	}
+	
+	munmap(map, sizeof(cfg_cache));
+	
+	return valid ? 0 : -1;
+}
+
+int cfg_cache_write(const char *cache_path, const cfg_cache_stamp *sources, const cfg_settings *settings)
+{
+	cfg_cache  cache;
+	char      *temp_path;
+	int        fd;
+	int        error = 0;
+	
+	/* Cleared so no stack contents end up in the padding */
+	memset(&cache, 0, sizeof(cache));
+	
+	memcpy(cache.magic, CFG_CACHE_MAGIC, sizeof(cache.magic));
+	cache.version = CFG_CACHE_VERSION;
+	cache.length = sizeof(cfg_settings);
+	cache.sources[0] = sources[0];
+	cache.sources[1] = sources[1];
+	memcpy(&cache.settings, settings, sizeof(cfg_settings));
+	cache.crc = cfg_cache_checksum(&cache);
+	
+	if (!(temp_path = malloc(strlen(cache_path) + 5)))
+	{
+		return -1;
+	}
+	
+	sprintf(temp_path, "%s.tmp", cache_path);
+	
+	if ((fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+	{
+		free(temp_path);
+		return -1;
+	}
+	
+	if (write(fd, &cache, sizeof(cache)) != (ssize_t)sizeof(cache) || fsync(fd) != 0)
+	{
+		error = -1;
+	}
+	
+	if (close(fd) != 0)
+	{
+		error = -1;
+	}
+	
+	/* The directory is synced as well so the rename survives a power cut */
+	if (!error && (rename(temp_path, cache_path) != 0 || ini_sync_directory(cache_path) != INI_ERROR_SUCCESS))
+	{
+		error = -1;
+	}
+	
+	if (error)
+	{
+		remove(temp_path);
+	}
+	
+	free(temp_path);
+	
+	return error;
+}
+
+void cfg_cache_load(const char *ro_path, const char *rw_path, const char *cache_path, cfg_settings *settings)
+{
+	cfg_cache_stamp sources[2];
+	
+	/* Stamped before parsing so a file changed during the parse leaves the cache stale */
+	cfg_cache_stamp_file(ro_path, &sources[0]);
+	cfg_cache_stamp_file(rw_path, &sources[1]);
+	
+	if (cfg_cache_read(cache_path, sources, settings) == 0)
+	{
+		return;
+	}
+	
+	cfg_file_read(ro_path, rw_path, settings);
+	
+	/* Without a cache the next start parses again - nothing else changes */
+	cfg_cache_write(cache_path, sources, settings);
+}
@@ -13,20 +13,39 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
  */
- 
+
+#include <ctype.h>
 #include "ini.h"
 #include "cfg.h"
 
+/* Opens a settings file for reading
+	- A missing or empty file leaves the defaults in place silently, any other error
+	  is reported as the settings in the file are then ignored */
+static int cfg_view_open(const char *path, ini_view_file *input)
+{
+	ini_error error = ini_view_open(path, input);
+	
+	if (error != INI_ERROR_SUCCESS && error != INI_ERROR_OPEN_FAILED && error != INI_ERROR_NO_DEFINITIONS)
+	{
+		fprintf(stderr, "Error %d reading %s - its settings are ignored\n", (int)error, path);
+	}
+	
+	return (error == INI_ERROR_SUCCESS) ? 0 : -1;
+}
+
 void cfg_file_read(const char *ro_path, const char *rw_path, cfg_settings *settings)
 {
-	unsigned int  i, k;
-	ini_key      *key;
-	ini_key_list  input;
+	unsigned int    i;
+	const ini_view *value;
+	ini_view_file   input; /* Views into the mapped file - nothing is copied */
 	
-	memset(&input, 0, sizeof(input));
+	/* Cleared so the padding is the same every time the settings are compiled into the cache */
+	memset(settings, 0, sizeof(cfg_settings));
 	
 	settings->default_pressure = 32;
 	settings->analog_to_button_deadzone = 64;
+	settings->frame_sync = 1;
+	settings->frame_sync_guard = 2000;
 	
 	settings->ds3_leds[0] = 1;
 	settings->ds3_leds[1] = 0;
@@ -46,121 +65,137 @@ void cfg_file_read(const char *ro_path, const char *rw_path, cfg_settings *setti
 		settings->map.inputs.by_offset[i] = -1;
 	}
 	
-    if (ini_read(rw_path, &input) == INI_ERROR_SUCCESS)
+	if (!cfg_view_open(rw_path, &input))
 	{
 		int color;
 		
-		if ((key = ini_key_list_search(&input, "ds4", "led_red")))
+		if ((value = ini_view_search(&input, "ds4", "led_red")))
 		{
-			color = atoi(key->value);
+			color = ini_view_long(value);
 			color = (color > 255) ? 255 : color;
 			color = (color < 0) ? 0 : color;
 			
 			settings->ds4_leds[DS4_LED_RED] = (uint8_t)color;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "led_green")))
+		if ((value = ini_view_search(&input, "ds4", "led_green")))
 		{
-			color = atoi(key->value);
+			color = ini_view_long(value);
 			color = (color > 255) ? 255 : color;
 			color = (color < 0) ? 0 : color;
 			
 			settings->ds4_leds[DS4_LED_GREEN] = (uint8_t)color;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "led_blue")))
+		if ((value = ini_view_search(&input, "ds4", "led_blue")))
 		{
-			color = atoi(key->value);
+			color = ini_view_long(value);
 			color = (color > 255) ? 255 : color;
 			color = (color < 0) ? 0 : color;
 			
 			settings->ds4_leds[DS4_LED_BLUE] = (uint8_t)color;
 		}
 		
-		ini_key_list_empty(&input);
+		ini_view_close(&input);
 		memset(&input, 0, sizeof(input));
 	}
 	
-	if (ini_read(ro_path, &input) == INI_ERROR_SUCCESS)
+	if (!cfg_view_open(ro_path, &input))
 	{
 		int pressure;
 		
-		if ((key = ini_key_list_search(&input, "common", "default_pressure")))
+		if ((value = ini_view_search(&input, "common", "default_pressure")))
 		{
-			pressure = atoi(key->value);
+			pressure = ini_view_long(value);
 			pressure = (pressure > 255) ? 255 : pressure;
 			pressure = (pressure < 1) ? 1 : pressure;
 			
 			settings->default_pressure = pressure;
 		}
 		
-		if ((key = ini_key_list_search(&input, "common", "analog_to_button_deadzone")))
+		if ((value = ini_view_search(&input, "common", "analog_to_button_deadzone")))
 		{
 			int deadzone;
 			
-			deadzone = atoi(key->value);
+			deadzone = ini_view_long(value);
 			deadzone = (deadzone > 126) ? 126 : deadzone;
 			deadzone = (deadzone < 0) ? 0 : deadzone;
 			
 			settings->analog_to_button_deadzone = deadzone;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds3", "led_one")))
+		if ((value = ini_view_search(&input, "common", "frame_sync")))
+		{
+			settings->frame_sync = (ini_view_equals(value, "true")) ? 1 : 0;
+		}
+		
+		if ((value = ini_view_search(&input, "common", "frame_sync_guard")))
 		{
-			settings->ds3_leds[0] = (!strcmp(key->value, "on")) ? 1 : 0;
+			int guard;
+			
+			guard = ini_view_long(value);
+			guard = (guard > 10000) ? 10000 : guard;
+			guard = (guard < 100) ? 100 : guard;
+			
+			settings->frame_sync_guard = guard;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds3", "led_two")))
+		if ((value = ini_view_search(&input, "ds3", "led_one")))
 		{
-			settings->ds3_leds[1] = (!strcmp(key->value, "on")) ? 1 : 0;
+			settings->ds3_leds[0] = (ini_view_equals(value, "on")) ? 1 : 0;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "triangle_pressure")))
+		if ((value = ini_view_search(&input, "ds3", "led_two")))
 		{
-			pressure = atoi(key->value);
+			settings->ds3_leds[1] = (ini_view_equals(value, "on")) ? 1 : 0;
+		}
+		
+		if ((value = ini_view_search(&input, "ds4", "triangle_pressure")))
+		{
+			pressure = ini_view_long(value);
 			pressure = (pressure > 255) ? 255 : pressure;
 			pressure = (pressure < 1) ? 1 : pressure;
 			
 			settings->ds4_triangle_pressure = pressure;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "circle_pressure")))
+		if ((value = ini_view_search(&input, "ds4", "circle_pressure")))
 		{
-			pressure = atoi(key->value);
+			pressure = ini_view_long(value);
 			pressure = (pressure > 255) ? 255 : pressure;
 			pressure = (pressure < 1) ? 1 : pressure;
 			
 			settings->ds4_circle_pressure = pressure;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "cross_pressure")))
+		if ((value = ini_view_search(&input, "ds4", "cross_pressure")))
 		{
-			pressure = atoi(key->value);
+			pressure = ini_view_long(value);
 			pressure = (pressure > 255) ? 255 : pressure;
 			pressure = (pressure < 1) ? 1 : pressure;
 			
 			settings->ds4_cross_pressure = pressure;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "square_pressure")))
+		if ((value = ini_view_search(&input, "ds4", "square_pressure")))
 		{
-			pressure = atoi(key->value);
+			pressure = ini_view_long(value);
 			pressure = (pressure > 255) ? 255 : pressure;
 			pressure = (pressure < 1) ? 1 : pressure;
 			
 			settings->ds4_square_pressure = pressure;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "analog_range_emulation_default")))
+		if ((value = ini_view_search(&input, "ds4", "analog_range_emulation_default")))
 		{
-			settings->ds4_range_emulation_default = (!strcmp(key->value, "true")) ? 1 : 0;
+			settings->ds4_range_emulation_default = (ini_view_equals(value, "true")) ? 1 : 0;
 		}
 		
-		if ((key = ini_key_list_search(&input, "ds4", "analog_range_emulation_divisor")))
+		if ((value = ini_view_search(&input, "ds4", "analog_range_emulation_divisor")))
 		{
 			double divisor;
 			
-			divisor = atof(key->value);
+			divisor = ini_view_double(value);
 			divisor = (divisor > 1.0) ? 1.0 : divisor;
 			divisor = (divisor < 0.1) ? 0.1 : divisor;
 			
@@ -169,23 +204,53 @@ void cfg_file_read(const char *ro_path, const char *rw_path, cfg_settings *setti
 		
 		for (i = 0; i < 24; i++)
 		{
-			if ((key = ini_key_list_search(&input, "custom_mapping", controller_map_offset_to_string[i])))
+			if ((value = ini_view_search(&input, "custom_mapping", controller_map_offset_to_string[i])))
 			{
-				for (k = 0; k < 24; k++)
-				{
-					if (!strcmp(key->value, controller_map_offset_to_string[k]))
-					{
-						settings->map.inputs.by_offset[i] = k;
-					}
-				}
+				/* -1 for a value naming no control, which leaves the control unassigned */
+				settings->map.inputs.by_offset[i] = controller_map_string_to_offset(value->text, value->length);
 			}
 		}
 		
-		ini_key_list_empty(&input);
+		ini_view_close(&input);
 	}
 }
 
-void cfg_file_write(const char *rw_path, cfg_settings *settings)
+void cfg_file_read_address(const char *ro_path, const char *address, cfg_settings *settings)
+{
+	unsigned int    i, k;
+	const ini_view *value;
+	ini_view_file   input;
+	char            sections[2][64];
+	
+	if (cfg_view_open(ro_path, &input))
+	{
+		return;
+	}
+	
+	/* Addresses are accepted in either case as tools print both */
+	sprintf(sections[0], "custom_mapping.%.17s", address);
+	sprintf(sections[1], "custom_mapping.%.17s", address);
+	
+	for (k = 0; sections[1][k]; k++)
+	{
+		sections[1][k] = (char)toupper((unsigned char)sections[1][k]);
+	}
+	
+	memcpy(sections[1], "custom_mapping", 14);
+	
+	for (i = 0; i < 24; i++)
+	{
+		if ((value = ini_view_search(&input, sections[0], controller_map_offset_to_string[i]))
+		||  (value = ini_view_search(&input, sections[1], controller_map_offset_to_string[i])))
+		{
+			settings->map.inputs.by_offset[i] = controller_map_string_to_offset(value->text, value->length);
+		}
+	}
+	
+	ini_view_close(&input);
+}
+
+void cfg_file_write(const char *rw_path, const cfg_settings *settings)
 {
 	ini_key_list output;
 	char         buffer_value[256];
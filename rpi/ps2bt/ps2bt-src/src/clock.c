@@ -0,0 +1,71 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* clock_gettime(), clock_nanosleep() */
+
+#include <time.h>
+#include "clock.h"
+
+static int     clock_virtual = 0;
+static int64_t clock_virtual_time = 0;
+
+void clock_use_virtual(int64_t start)
+{
+	clock_virtual = 1;
+	clock_virtual_time = start;
+}
+
+int64_t clock_now(void)
+{
+	if (clock_virtual)
+	{
+		return clock_virtual_time;
+	}
+	
+	return clock_real();
+}
+
+int64_t clock_real(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* The virtual clock jumps straight to the wake up time */
+void clock_sleep_until(int64_t time)
+{
+	struct timespec t;
+	
+	if (clock_virtual)
+	{
+		if (time > clock_virtual_time)
+		{
+			clock_virtual_time = time;
+		}
+		
+		return;
+	}
+	
+	t.tv_sec = (time_t)(time / 1000000000);
+	t.tv_nsec = (long)(time % 1000000000);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0) continue;
+}
+
+void clock_sleep(int64_t duration)
+{
+	clock_sleep_until(clock_now() + duration);
+}
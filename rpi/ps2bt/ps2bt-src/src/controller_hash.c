@@ -0,0 +1,42 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "controller.h"
+#include "controller_hash.h" /* Generated from controller_map_offset_to_string by tools/genhash.c */
+
+int controller_map_string_to_offset(const char *text, size_t length)
+{
+	uint32_t hash = CONTROLLER_HASH_SEED;
+	size_t   i;
+	int      offset;
+	
+	for (i = 0; i < length; i++)
+	{
+		hash = CONTROLLER_HASH_STEP(hash, text[i]);
+	}
+	
+	offset = controller_hash_table[CONTROLLER_HASH_SLOT(hash, CONTROLLER_HASH_MASK)];
+	
+	/* Any other text also lands on some slot so the one candidate is compared */
+	if (offset < 0 || controller_hash_length[offset] != length
+	||  memcmp(controller_map_offset_to_string[offset], text, length))
+	{
+		return -1;
+	}
+	
+	return offset;
+}
@@ -14,9 +14,171 @@
  * GNU General Public License for more details.
  */
 
+#define _POSIX_C_SOURCE 200112L /* fileno(), fsync(), mmap() */
+
 #include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ini.h"
 
+typedef ini_error (*ini_parse_callback)(void *context, const char *section, unsigned int length_section,
+                                        const char *key, unsigned int length_key,
+                                        const char *value, unsigned int length_value);
+
+#define INI_ARENA_BLOCK 4096 /* Size of the first arena block - each further block doubles */
+#define INI_INDEX_MIN   64   /* Slots in the first index - the index doubles at half full */
+
+typedef union
+{
+	void  *pointer;
+	double number;
+	long   integer;
+} ini_align;
+
+#define INI_ALIGN(size) (((size) + sizeof(ini_align) - 1) / sizeof(ini_align) * sizeof(ini_align))
+
+/* 0 - success
+  -1 - failed to allocate memory */
+static int ini_arena_add(ini_key_list *list, size_t size)
+{
+	ini_arena *arena;
+	
+	if (!(arena = (ini_arena *)malloc(INI_ALIGN(sizeof(ini_arena)) + size)))
+	{
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	arena->storage = (char *)arena + INI_ALIGN(sizeof(ini_arena));
+	arena->size = size;
+	arena->used = 0;
+	arena->next = list->arena;
+	list->arena = arena;
+	
+	return INI_ERROR_SUCCESS;
+}
+
+/* NULL - failed to allocate memory */
+static void *ini_arena_alloc(ini_key_list *list, size_t size)
+{
+	ini_arena *arena = list->arena;
+	void      *allocation;
+	
+	size = INI_ALIGN(size);
+	
+	if (!arena || arena->size - arena->used < size)
+	{
+		size_t block = arena ? arena->size * 2 : INI_ARENA_BLOCK;
+		
+		if (ini_arena_add(list, (block < size) ? size : block) != INI_ERROR_SUCCESS)
+		{
+			return NULL;
+		}
+		
+		arena = list->arena;
+	}
+	
+	allocation = &arena->storage[arena->used];
+	arena->used += size;
+	
+	return allocation;
+}
+
+/* FNV-1a over the section and key - keys without a section hash differently from an empty section */
+static unsigned int ini_hash(const char *section, size_t length_section, const char *key, size_t length_key)
+{
+	unsigned int hash = 2166136261U;
+	size_t       i;
+	
+	if (section)
+	{
+		for (i = 0; i < length_section; i++)
+		{
+			hash = (hash ^ (unsigned char)section[i]) * 16777619U;
+		}
+		
+		hash = (hash ^ 0xFF) * 16777619U;
+	}
+	else
+	{
+		hash = (hash ^ 0x01) * 16777619U;
+	}
+	
+	for (i = 0; i < length_key; i++)
+	{
+		hash = (hash ^ (unsigned char)key[i]) * 16777619U;
+	}
+	
+	return hash & 0xFFFFFFFFU;
+}
+
+/* Returns the slot holding section and key or the empty slot where they belong */
+static unsigned int ini_index_slot(ini_key_list *list, const char *section, const char *key, unsigned int hash)
+{
+	unsigned int mask = list->index_size - 1;
+	unsigned int slot = hash & mask;
+	
+	while (list->index[slot])
+	{
+		ini_key *current = list->index[slot];
+		
+		if (current->hash == hash && !strcmp(current->key, key)
+		&& (section ? (current->section && !strcmp(current->section, section)) : !current->section))
+		{
+			break;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	return slot;
+}
+
+/* 0 - success
+  -1 - failed to allocate memory */
+static int ini_index_grow(ini_key_list *list)
+{
+	ini_key    **old_index = list->index;
+	unsigned int old_size = list->index_size;
+	unsigned int size = old_size ? old_size * 2 : INI_INDEX_MIN;
+	unsigned int i;
+	
+	if (!(list->index = (ini_key **)calloc(size, sizeof(ini_key *))))
+	{
+		list->index = old_index;
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	list->index_size = size;
+	
+	for (i = 0; i < old_size; i++)
+	{
+		if (old_index[i])
+		{
+			ini_key *current = old_index[i];
+			
+			list->index[ini_index_slot(list, current->section, current->key, current->hash)] = current;
+		}
+	}
+	
+	free(old_index);
+	
+	return INI_ERROR_SUCCESS;
+}
+
+static ini_key *ini_index_find(ini_key_list *list, const char *section, const char *key)
+{
+	if (!list->index_size)
+	{
+		return NULL;
+	}
+	
+	return list->index[ini_index_slot(list, section, key, ini_hash(section, section ? strlen(section) : 0,
+	                                                                 key, strlen(key)))];
+}
+
 /* 0 - success
   -1 - failed to allocate memory */
 static int ini_key_list_insert_internal(ini_key_list *list, const char *section, unsigned int length_section,
@@ -27,14 +189,20 @@ static int ini_key_list_insert_internal(ini_key_list *list, const char *section,
 	unsigned int size_section;
 	unsigned int size_key;
 	unsigned int size_value;
+	unsigned int slot;
 	ini_key *next;
 	
+	if ((list->index_used + 1) * 2 > list->index_size && ini_index_grow(list) != INI_ERROR_SUCCESS)
+	{
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
 	size_section = section ? length_section + 1 : 0;
 	size_key = length_key + 1;
 	size_value = length_value + 1;
 	offset = 0;
 	
-	next = (ini_key *)calloc(1, sizeof(ini_key) - 1 + size_section + size_key + size_value);
+	next = (ini_key *)ini_arena_alloc(list, offsetof(ini_key, storage) + size_section + size_key + size_value);
 	if (!next)
 	{
 		return INI_ERROR_MALLOC_FAILED;
@@ -44,6 +212,7 @@ static int ini_key_list_insert_internal(ini_key_list *list, const char *section,
 	{
 		next->section = &next->storage[offset];
 		memcpy(next->section, section, (size_t)length_section);
+		next->section[length_section] = '\0';
 		offset += size_section;
 	}
 	else
@@ -53,12 +222,16 @@ static int ini_key_list_insert_internal(ini_key_list *list, const char *section,
 	
 	next->key = &next->storage[offset];
 	memcpy(next->key, key, length_key);
+	next->key[length_key] = '\0';
 	offset += size_key;
 	
 	next->value = &next->storage[offset];
 	memcpy(next->value, value, length_value);
+	next->value[length_value] = '\0';
 	
 	next->next = NULL;
+	next->hash = ini_hash(next->section, length_section, next->key, length_key);
+	next->order = list->count++;
 	
 	if (!list->head)
 	{
@@ -71,6 +244,15 @@ static int ini_key_list_insert_internal(ini_key_list *list, const char *section,
 		list->tail = next;
 	}
 	
+	/* Only the first definition is indexed */
+	slot = ini_index_slot(list, next->section, next->key, next->hash);
+	
+	if (!list->index[slot])
+	{
+		list->index[slot] = next;
+		list->index_used++;
+	}
+	
 	return INI_ERROR_SUCCESS;
 }
 
@@ -209,251 +391,306 @@ ini_error ini_key_list_insert(ini_key_list *list, const char *section, const cha
 	return ini_key_list_insert_internal(list, section, strlen(section), key, strlen(key), value, strlen(value));
 }
 
+/* All keys are freed at once with their arena blocks */
 void ini_key_list_empty(ini_key_list *list)
 {
-	ini_key *next;
-	
-	while (list->head)
+	while (list->arena)
 	{
-		next = list->head->next;
-		free(list->head);
-		list->head = next;
+		ini_arena *next = list->arena->next;
+		
+		free(list->arena);
+		list->arena = next;
 	}
+	
+	free(list->index);
+	
+	memset(list, 0, sizeof(ini_key_list));
 }
 
 /* !NULL - found
     NULL - not found */
 ini_key *ini_key_list_search(ini_key_list *list, const char *section, const char *key)
 {
-	ini_key *current = list->head;
+	ini_key *exact;
+	ini_key *any;
 	
-	while (current)
+	/* Any section - only a walk finds the first definition */
+	if (!section)
 	{
-		if (!section || !current->section || !strcmp(current->section, section))
+		ini_key *current = list->head;
+		
+		while (current && strcmp(current->key, key))
 		{
-			if (!strcmp(current->key, key))
-			{
-				break;
-			}
+			current = current->next;
 		}
 		
-		current = current->next;
+		return current;
 	}
 	
-	return current;
+	exact = ini_index_find(list, section, key);
+	any = ini_index_find(list, NULL, key);
+	
+	if (exact && any)
+	{
+		return (any->order < exact->order) ? any : exact;
+	}
+	
+	return exact ? exact : any;
 }
 
-/* 0 - success
-  -1 - failed to allocate memory
-  -2 - failed to open file
-  -3 - failed to read file
-  -4 - invalid text file (contains character '\0')
-  -6 - no valid key definitions */
-ini_error ini_read(const char *path, ini_key_list *list)
+/* Parses length bytes of buffer and calls callback for every key in order
+	- Sections, keys and values are passed as pointers into buffer with their lengths
+	- Parsing stops at the first error returned by callback
+	  0 - success
+	 -4 - invalid text file (contains character '\0') */
+static ini_error ini_parse(const char *buffer, size_t length, ini_parse_callback callback, void *context)
 {
-	ini_error  error;
-	char      *buffer;
+	ini_error     error;
+	const char   *s;
+	const char   *end;
+	const char   *section, *tmp_section;
+	const char   *key;
+	const char   *value;
+	unsigned int  length_section;
+	unsigned int  length_key;
+	unsigned int  length_value;
+	int           state;
 	
-	ini_key_list_empty(list);
+	section = NULL;
+	tmp_section = NULL;
+	key = NULL;
+	value = NULL;
+	length_section = 0;
+	length_key = 0;
+	length_value = 0;
 	
-	if ((error = ini_read_file(path, &buffer, NULL)) != 0)
-	{
-		return error;
-	}
+	s = buffer;
+	end = buffer + length;
+	state = 0;
 	
+	while (s <= end)
 	{
-		const char   *s;
-		const char   *section, *tmp_section;
-		const char   *key;
-		const char   *value;
-		unsigned int  length_section;
-		unsigned int  length_key;
-		unsigned int  length_value;
-		int           state;
+		char cur;
+		char c;
 		
-		section = NULL;
-		tmp_section = NULL;
-		key = NULL;
-		value = NULL;
-		length_section = 0;
-		length_key = 0;
-		length_value = 0;
+		/* The end of the buffer reads as one more newline */
+		cur = (s < end) ? *s : '\n';
 		
-		s = buffer;
-		state = 0;
+		if (!cur)
+		{
+			return INI_ERROR_INVALID_FILE;
+		}
 		
-		while (*s)
+		c = (isspace(cur) && cur != '\n') ? ' ' : cur;
+		c = (ispunct(c) && c != ';' && c != '#') ? '.' : c;
+		c = (isalnum(c)) ? 'a' : c;
+		
+		switch (state)
 		{
-			char c;
-			
-			c = (isspace(*s) && *s != '\n') ? ' ' : *s;
-			c = (ispunct(c) && c != ';' && c != '#') ? '.' : c;
-			c = (isalnum(c)) ? 'a' : c;
-			
-			switch (state)
+			case 0:
 			{
-				case 0:
+				if (c == ' ' || c == '\n')
 				{
-					if (c == ' ' || c == '\n')
-					{
-						state = 0;
-					}
-					else if (*s == '[')
-					{
-						state = 10;
-					}
-					else if (c == 'a' || c == '.')
-					{
-						key = s;
-						state = 20;
-					}
-					else if (c == ';' || c == '#')
-					{
-						state = 99;
-					}
-					
-					break;
+					state = 0;
 				}
-				/* Parse section */
-				case 10:
+				else if (cur == '[')
 				{
-					if (*s != ']' && (c == 'a' || c == '.'))
-					{
-						tmp_section = s;
-						state = 11;
-					}
-					else if (c != ' ')
-					{
-						state = 99;
-					}
-					
-					break;
+					state = 10;
 				}
-				case 11:
+				else if (c == 'a' || c == '.')
 				{
-					if (c == ' ')
-					{
-						state = 12;
-					}
-					else if (c != 'a' && c != '.')
-					{
-						state = 99;
-					}
-					
-					if (*s != ']')
-					{
-						break;
-					}
-					/* Fall through */
+					key = s;
+					state = 20;
 				}
-				case 12:
+				else if (c == ';' || c == '#')
 				{
-					if (*s == ']')
-					{
-						const char *ss;
-						
-						ss = s - 1;
-						
-						while (isspace(*ss)) ss--;
-						
-						length_section = ss - tmp_section + 1;
-						section = tmp_section;
-						
-						state = 99;
-					}
-					else if (c != ' ')
-					{
-						state = 99;
-					}
-					
-					break;
+					state = 99;
 				}
-				/* Parse key and value */
-				case 20:
+				
+				break;
+			}
+			/* Parse section */
+			case 10:
+			{
+				if (cur != ']' && (c == 'a' || c == '.'))
 				{
-					if (c == ' ' || *s == '=')
-					{
-						length_key = s - key;
-						
-						state = (c == ' ') ? 21 : 22;
-					}
-					else if (c != 'a' && c != '.')
-					{
-						state = 99;
-					}
-					
-					break;
+					tmp_section = s;
+					state = 11;
 				}
-				case 21:
+				else if (c != ' ')
+				{
+					state = 99;
+				}
+				
+				break;
+			}
+			case 11:
+			{
+				if (c == ' ')
+				{
+					state = 12;
+				}
+				else if (c != 'a' && c != '.')
+				{
+					state = 99;
+				}
+				
+				if (cur != ']')
 				{
-					if (*s == '=')
-					{
-						state = 22;
-					}
-					else if (c != ' ')
-					{
-						state = 99;
-					}
-					
 					break;
 				}
-				case 22:
+			}
+			/* fall through */
+			case 12:
+			{
+				if (cur == ']')
 				{
-					if (c == 'a' || c == '.')
-					{
-						value = s;
-						state = 23;
-					}
-					else if (c != ' ')
-					{
-						state = 99;
-					}
+					const char *ss;
 					
-					break;
+					ss = s - 1;
+					
+					while (isspace(*ss)) ss--;
+					
+					length_section = ss - tmp_section + 1;
+					section = tmp_section;
+					
+					state = 99;
 				}
-				case 23:
+				else if (c != ' ')
 				{
-					if (c == ' ' || c == '\n' || c == ';' || c == '#')
-					{
-						length_value = s - value;
-						
-						if ((error = ini_key_list_insert_internal(list, section, length_section, key, 
-						                                          length_key, value, length_value)) != 0)
-						{
-							ini_key_list_empty(list);
-							free(buffer);
-							return error;
-						}
-						
-						state = 99;
-					}
-					else if (c != 'a' && c != '.')
-					{
-						state = 99;
-					}
+					state = 99;
+				}
+				
+				break;
+			}
+			/* Parse key and value */
+			case 20:
+			{
+				if (c == ' ' || cur == '=')
+				{
+					length_key = s - key;
 					
-					break;
+					state = (c == ' ') ? 21 : 22;
+				}
+				else if (c != 'a' && c != '.')
+				{
+					state = 99;
+				}
+				
+				break;
+			}
+			case 21:
+			{
+				if (cur == '=')
+				{
+					state = 22;
+				}
+				else if (c != ' ')
+				{
+					state = 99;
 				}
-				case 100:
+				
+				break;
+			}
+			case 22:
+			{
+				if (c == 'a' || c == '.')
 				{
-					if (c == '\n')
+					value = s;
+					state = 23;
+				}
+				else if (c != ' ')
+				{
+					state = 99;
+				}
+				
+				break;
+			}
+			case 23:
+			{
+				if (c == ' ' || c == '\n' || c == ';' || c == '#')
+				{
+					length_value = s - value;
+					
+					if ((error = callback(context, section, length_section, key,
+					                      length_key, value, length_value)) != INI_ERROR_SUCCESS)
 					{
-						state = 0;
+						return error;
 					}
 					
-					break;
+					state = 99;
 				}
+				else if (c != 'a' && c != '.')
+				{
+					state = 99;
+				}
+				
+				break;
 			}
-			
-			if (state == 99) 
-			{
-				state = 100;
-			}
-			else
+			case 100:
 			{
-				s++;
+				if (c == '\n')
+				{
+					state = 0;
+				}
+				
+				break;
 			}
 		}
+		
+		if (state == 99) 
+		{
+			state = 100;
+		}
+		else
+		{
+			s++;
+		}
+	}
+	
+	return INI_ERROR_SUCCESS;
+}
+
+/* Copies each key into the list */
+static ini_error ini_parse_insert(void *context, const char *section, unsigned int length_section,
+                                  const char *key, unsigned int length_key,
+                                  const char *value, unsigned int length_value)
+{
+	return ini_key_list_insert_internal((ini_key_list *)context, section, length_section,
+	                                    key, length_key, value, length_value);
+}
+
+/* 0 - success
+  -1 - failed to allocate memory
+  -2 - failed to open file
+  -3 - failed to read file
+  -4 - invalid text file (contains character '\0')
+  -6 - no valid key definitions */
+ini_error ini_read(const char *path, ini_key_list *list)
+{
+	ini_error     error;
+	char         *buffer;
+	unsigned int  size;
+	
+	ini_key_list_empty(list);
+	
+	if ((error = ini_read_file(path, &buffer, &size)) != 0)
+	{
+		return error;
+	}
+	
+	/* Twice the file covers the copied section names and key headers of typical files in one block */
+	if ((error = ini_arena_add(list, (size_t)size * 2 + INI_ARENA_BLOCK)) != 0)
+	{
+		free(buffer);
+		return error;
+	}
+	
+	if ((error = ini_parse(buffer, size, &ini_parse_insert, list)) != INI_ERROR_SUCCESS)
+	{
+		ini_key_list_empty(list);
+		free(buffer);
+		return error;
 	}
 	
 	free(buffer);
@@ -466,29 +703,384 @@ ini_error ini_read(const char *path, ini_key_list *list)
 	return INI_ERROR_SUCCESS;
 }
 
+static int ini_view_matches(const ini_view *view, const char *text, size_t length)
+{
+	return view->length == length && !memcmp(view->text, text, length);
+}
+
+/* Returns the slot holding section and key or the empty slot where they belong */
+static unsigned int ini_view_slot(ini_view_file *file, const char *section, size_t length_section,
+                                  const char *key, size_t length_key, unsigned int hash)
+{
+	unsigned int mask = file->capacity * 2 - 1;
+	unsigned int slot = hash & mask;
+	
+	while (file->index[slot])
+	{
+		ini_view_key *current = &file->keys[file->index[slot] - 1];
+		
+		if (current->hash == hash && ini_view_matches(&current->key, key, length_key)
+		&& (section ? (current->section.text && ini_view_matches(&current->section, section, length_section))
+		            : !current->section.text))
+		{
+			break;
+		}
+		
+		slot = (slot + 1) & mask;
+	}
+	
+	return slot;
+}
+
+static ini_view_key *ini_view_find(ini_view_file *file, const char *section, const char *key)
+{
+	size_t       length_section = section ? strlen(section) : 0;
+	size_t       length_key = strlen(key);
+	unsigned int slot = ini_view_slot(file, section, length_section, key, length_key,
+	                                  ini_hash(section, length_section, key, length_key));
+	
+	return file->index[slot] ? &file->keys[file->index[slot] - 1] : NULL;
+}
+
+/* Doubles the capacity of file and indexes its keys again
+	- Keys are indexed in file order so the first definition of each is indexed as before */
+static ini_error ini_view_grow(ini_view_file *file)
+{
+	unsigned int  capacity = file->capacity * 2;
+	ini_view_key *keys;
+	unsigned int *index;
+	unsigned int  i;
+	
+	if (!(keys = (ini_view_key *)malloc(capacity * sizeof(ini_view_key))))
+	{
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	if (!(index = (unsigned int *)calloc(capacity * 2, sizeof(unsigned int))))
+	{
+		free(keys);
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	memcpy(keys, file->keys, file->count * sizeof(ini_view_key));
+	
+	if (file->keys != file->local_keys)
+	{
+		free(file->keys);
+		free(file->index);
+	}
+	
+	file->keys = keys;
+	file->index = index;
+	file->capacity = capacity;
+	
+	for (i = 0; i < file->count; i++)
+	{
+		ini_view_key *current = &keys[i];
+		unsigned int  slot;
+		
+		slot = ini_view_slot(file, current->section.text, current->section.length,
+		                     current->key.text, current->key.length, current->hash);
+		
+		if (!index[slot])
+		{
+			index[slot] = i + 1;
+		}
+	}
+	
+	return INI_ERROR_SUCCESS;
+}
+
+/* Records views of every key in file order - only the first definition of a key is indexed */
+static ini_error ini_parse_view(void *context, const char *section, unsigned int length_section,
+                                const char *key, unsigned int length_key,
+                                const char *value, unsigned int length_value)
+{
+	ini_view_file *file = (ini_view_file *)context;
+	ini_view_key  *current;
+	unsigned int   slot;
+	ini_error      error;
+	
+	if (file->count == file->capacity && (error = ini_view_grow(file)) != INI_ERROR_SUCCESS)
+	{
+		return error;
+	}
+	
+	current = &file->keys[file->count];
+	
+	current->section.text = section;
+	current->section.length = length_section;
+	current->key.text = key;
+	current->key.length = length_key;
+	current->value.text = value;
+	current->value.length = length_value;
+	current->hash = ini_hash(section, length_section, key, length_key);
+	
+	slot = ini_view_slot(file, section, length_section, key, length_key, current->hash);
+	
+	if (!file->index[slot])
+	{
+		file->index[slot] = file->count + 1;
+	}
+	
+	file->count++;
+	
+	return INI_ERROR_SUCCESS;
+}
+
 /* 0 - success
-  -1 - failed to open file
-  -5 - failed to write file*/
+  -1 - failed to allocate memory for more than INI_VIEW_MAX_KEYS keys
+  -2 - failed to open file
+  -3 - failed to read file
+  -4 - invalid text file (contains character '\0')
+  -6 - no valid key definitions
+   On success the file stays mapped until ini_view_close() */
+ini_error ini_view_open(const char *path, ini_view_file *file)
+{
+	ini_error   error;
+	struct stat info;
+	void       *map;
+	int         fd;
+	
+	file->map = NULL;
+	file->size = 0;
+	file->count = 0;
+	file->capacity = INI_VIEW_MAX_KEYS;
+	file->keys = file->local_keys;
+	file->index = file->local_index;
+	
+	memset(file->local_index, 0, sizeof(file->local_index));
+	
+	if ((fd = open(path, O_RDONLY)) == -1)
+	{
+		return INI_ERROR_OPEN_FAILED;
+	}
+	
+	if (fstat(fd, &info) == -1)
+	{
+		close(fd);
+		return INI_ERROR_READ_FAILED;
+	}
+	
+	if (!info.st_size)
+	{
+		close(fd);
+		return INI_ERROR_NO_DEFINITIONS;
+	}
+	
+	map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	close(fd);
+	
+	if (map == MAP_FAILED)
+	{
+		return INI_ERROR_READ_FAILED;
+	}
+	
+	file->map = (const char *)map;
+	file->size = (size_t)info.st_size;
+	
+	if ((error = ini_parse(file->map, file->size, &ini_parse_view, file)) == INI_ERROR_SUCCESS
+	&&  !file->count)
+	{
+		error = INI_ERROR_NO_DEFINITIONS;
+	}
+	
+	if (error != INI_ERROR_SUCCESS)
+	{
+		ini_view_close(file);
+	}
+	
+	return error;
+}
+
+void ini_view_close(ini_view_file *file)
+{
+	if (file->map)
+	{
+		munmap((void *)file->map, file->size);
+	}
+	
+	if (file->keys != file->local_keys)
+	{
+		free(file->keys);
+		free(file->index);
+	}
+	
+	file->map = NULL;
+	file->size = 0;
+	file->count = 0;
+	file->capacity = INI_VIEW_MAX_KEYS;
+	file->keys = file->local_keys;
+	file->index = file->local_index;
+}
+
+/* !NULL - value of the key - same order of precedence as ini_key_list_search()
+    NULL - not found */
+const ini_view *ini_view_search(ini_view_file *file, const char *section, const char *key)
+{
+	ini_view_key *exact;
+	ini_view_key *any;
+	
+	/* Any section - only a walk finds the first definition */
+	if (!section)
+	{
+		unsigned int i;
+		
+		for (i = 0; i < file->count; i++)
+		{
+			if (ini_view_matches(&file->keys[i].key, key, strlen(key)))
+			{
+				return &file->keys[i].value;
+			}
+		}
+		
+		return NULL;
+	}
+	
+	exact = ini_view_find(file, section, key);
+	any = ini_view_find(file, NULL, key);
+	
+	if (exact && any)
+	{
+		return (any < exact) ? &any->value : &exact->value;
+	}
+	
+	return exact ? &exact->value : (any ? &any->value : NULL);
+}
+
+int ini_view_equals(const ini_view *view, const char *text)
+{
+	return ini_view_matches(view, text, strlen(text));
+}
+
+/* Values are copied to a terminated buffer so the C library does the conversion - anything past
+   the buffer cannot change the result for values that fit in a long or double */
+static void ini_view_terminate(const ini_view *view, char *buffer, size_t size)
+{
+	size_t length = (view->length < size - 1) ? view->length : size - 1;
+	
+	memcpy(buffer, view->text, length);
+	buffer[length] = '\0';
+}
+
+long ini_view_long(const ini_view *view)
+{
+	char buffer[32];
+	
+	ini_view_terminate(view, buffer, sizeof(buffer));
+	
+	return strtol(buffer, NULL, 10);
+}
+
+double ini_view_double(const ini_view *view)
+{
+	char buffer[64];
+	
+	ini_view_terminate(view, buffer, sizeof(buffer));
+	
+	return strtod(buffer, NULL);
+}
+
+/* 0 - success
+  -1 - failed to allocate memory
+  -2 - failed to open the directory
+  -5 - failed to sync the directory */
+ini_error ini_sync_directory(const char *path)
+{
+	ini_error  error = INI_ERROR_SUCCESS;
+	char      *directory;
+	char      *slash;
+	int        fd;
+	
+	if (!(directory = malloc(strlen(path) + 2)))
+	{
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	strcpy(directory, path);
+	
+	/* A file in the root directory keeps its slash */
+	if ((slash = strrchr(directory, '/')))
+	{
+		slash[(slash == directory) ? 1 : 0] = '\0';
+	}
+	else
+	{
+		strcpy(directory, ".");
+	}
+	
+	if ((fd = open(directory, O_RDONLY)) == -1)
+	{
+		free(directory);
+		return INI_ERROR_OPEN_FAILED;
+	}
+	
+	if (fsync(fd) != 0)
+	{
+		error = INI_ERROR_WRITE_FAILED;
+	}
+	
+	close(fd);
+	free(directory);
+	
+	return error;
+}
+
+/* 0 - success
+  -1 - failed to allocate memory
+  -2 - failed to open file
+  -5 - failed to write file
+   The list is written to a temporary file next to path which is synced and renamed over path
+   so path always holds either the old or the new contents - the directory is synced after
+   the rename so the new contents are still there after a power cut */
 ini_error ini_write(const char *path, ini_key_list *list)
 {
 	ini_error  error;
 	FILE      *output;
+	char      *temp_path;
 	
-	output = fopen(path, "wb");
+	if (!(temp_path = malloc(strlen(path) + 5)))
+	{
+		return INI_ERROR_MALLOC_FAILED;
+	}
+	
+	sprintf(temp_path, "%s.tmp", path);
+	
+	output = fopen(temp_path, "wb");
 	if (!output)
 	{
+		free(temp_path);
 		return INI_ERROR_OPEN_FAILED;
 	}
 	
-	if ((error = ini_fprint(output, list)) != 0)
+	if ((error = ini_fprint(output, list)) == INI_ERROR_SUCCESS
+	&&  (fflush(output) != 0 || fsync(fileno(output)) != 0))
 	{
-		fclose(output);
+		error = INI_ERROR_WRITE_FAILED;
+	}
+	
+	if (fclose(output) != 0 && error == INI_ERROR_SUCCESS)
+	{
+		error = INI_ERROR_WRITE_FAILED;
+	}
+	
+	if (error == INI_ERROR_SUCCESS && rename(temp_path, path) != 0)
+	{
+		error = INI_ERROR_WRITE_FAILED;
+	}
+	
+	if (error != INI_ERROR_SUCCESS)
+	{
+		remove(temp_path);
+		free(temp_path);
 		return error;
 	}
 	
-	fclose(output);
+	free(temp_path);
 	
-	return INI_ERROR_SUCCESS;
+	/* The new contents are in place even if this fails, they just may not survive a power cut */
+	return ini_sync_directory(path);
 }
 
 void ini_print(ini_key_list *list)
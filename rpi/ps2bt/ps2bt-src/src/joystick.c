@@ -13,15 +13,144 @@
  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  * GNU General Public License for more details.
  */
- 
+
+#include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/time.h>
 #include "joystick.h"
+#include "trace.h"
 #include "led.h"
 #include "rumble.h"
+#include "stats.h"
+
+/* Applies one joystick event to the inputs - shared by the polling thread and trace replay */
+void joystick_decode_event(unsigned int type, joystick_inputs *inputs, const struct js_event *event)
+{
+	switch (event->type)
+	{
+		case JS_EVENT_BUTTON:
+		{
+			if (type == 3)
+			{
+				if (event->number < 17)
+				{
+					inputs->buttons &= ~(1 << event->number);
+					inputs->buttons |= (event->value << event->number);
+				}
+			}
+			else
+			{
+				if (event->number < 14)
+				{
+					const unsigned int ds4_button_map[14] = { 15, 14, 13, 12, 10, 11, 8,
+					                                           9,  0,  3,  1,  2, 16, 17 };
+					
+					inputs->buttons &= ~(1 << ds4_button_map[event->number]);
+					inputs->buttons |= (event->value << ds4_button_map[event->number]);
+					
+					if (event->number < 12 && event->number != 6 && event->number != 7)
+					{
+						inputs->axes.buffer[ds4_button_map[event->number]] = event->value;
+					}
+				}
+			}
+			
+			break;
+		}
+		case JS_EVENT_AXIS:
+		{
+			if (type == 3)
+			{
+				if (event->number < 20 && (event->number <= 3 || event->number >= 8))
+				{
+					inputs->axes.buffer[(event->number < 8) ? event->number : event->number - 4] = event->value;
+				}
+			}
+			else
+			{
+				if (event->number < 8)
+				{
+					const unsigned int ds4_axis_map[6] = { 0, 1, 2, 8, 9, 3 };
+					
+					if (event->number == 6) /* DPAD Left/Right */
+					{
+						inputs->buttons &= ~(1 << 7); /* Left */
+						inputs->buttons |= (event->value < 0) << 7;
+						inputs->axes.buffer[7] = (event->value < 0);
+						inputs->buttons &= ~(1 << 5); /* Right */
+						inputs->buttons |= (event->value > 0) << 5;
+						inputs->axes.buffer[5] = (event->value > 0);
+					}
+					else if (event->number == 7) /* DPAD Up/Down */
+					{
+						inputs->buttons &= ~(1 << 4); /* Up */
+						inputs->buttons |= (event->value < 0) << 4;
+						inputs->axes.buffer[4] = (event->value < 0);
+						inputs->buttons &= ~(1 << 6); /* Down */
+						inputs->buttons |= (event->value > 0) << 6;
+						inputs->axes.buffer[6] = (event->value > 0);
+					}
+					else if (event->number == 3 || event->number == 4) /* L2/R2 */
+					{
+						inputs->axes.buffer[ds4_axis_map[event->number]] = event->value;
+					}
+					else /* Sticks */
+					{
+						inputs->axes.buffer[ds4_axis_map[event->number]] = event->value;
+					}
+				}
+			}
+			
+			break;
+		}
+	}
+}
+
+/* Initialize button pressures -- Joystick thread reports 
+   DS3 button pressure as -32767 to +32767 while
+   DS4 pressures are reported as 0 or 1 (except L2/R2) */
+void joystick_init_inputs(unsigned int type, joystick_inputs *inputs)
+{
+	memset(inputs, 0, sizeof(joystick_inputs));
+	
+	if (type == 3)
+	{
+		unsigned int i;
+		
+		for (i = 4; i < 16; i++)
+		{
+			inputs->axes.buffer[i] = -32767;
+		}
+	}
+	else
+	{
+		inputs->axes.buffer[8] = -32767;
+		inputs->axes.buffer[9] = -32767;
+	}
+}
+
+/* Events are traced while the mutex is held so each frame's trace record
+   follows exactly the events it observed */
+static void joystick_publish(joystick *js, joystick_inputs *inputs, struct js_event *events, unsigned int count)
+{
+	int64_t start = stats_time();
+	
+	pthread_mutex_lock(&js->inputs_mutex);
+	
+	js->inputs = *inputs;
+	
+	if (js->trace.file)
+	{
+		trace_write_events(&js->trace, events, count);
+	}
+	
+	pthread_mutex_unlock(&js->inputs_mutex);
+	
+	stats_record(&js->stats, STATS_PUBLISH, stats_time() - start);
+}
 
 /*  - Non-blocking I/O is used here with select() to provide both blocking reads and non-blocking read-ahead
 	- After each event is processed the next event is read ahead of time
@@ -33,9 +162,12 @@ static void *joystick_polling_thread(void *data)
 	fd_set           set;
 	struct timeval   timeout;
 	struct js_event  event;
+	struct js_event  events[JOYSTICK_BATCH_MAX];
+	unsigned int     count;
 	unsigned int     read_ahead;
 	joystick        *js;
 	joystick_inputs  inputs;
+	int64_t          start;
 	
 	timeout.tv_sec = 1;
 	timeout.tv_usec = 0;
@@ -52,101 +184,47 @@ static void *joystick_polling_thread(void *data)
 		
 		if (read_ahead || select(js->device + 1, &set, NULL, NULL, &timeout))
 		{
-			if (!read_ahead && read(js->device, &event, sizeof(struct js_event)) != sizeof(struct js_event))
+			if (!read_ahead)
 			{
-				js->thread_terminated = 1;
+				start = stats_time();
+				
+				if (read(js->device, &event, sizeof(struct js_event)) != sizeof(struct js_event))
+				{
+					js->thread_terminated = 1;
+					
+					return NULL;
+				}
 				
-				return NULL;
+				stats_record(&js->stats, STATS_EVENT_READ, stats_time() - start);
 			}
 			
 			read_ahead = 0;
+			count = 0;
 			
 			while (1) /* while(1) used for continue */
 			{
-				switch (event.type)
+				start = stats_time();
+				joystick_decode_event(js->type, &inputs, &event);
+				stats_record(&js->stats, STATS_DECODE, stats_time() - start);
+				
+				events[count++] = event;
+				
+				/* A long burst is published in pieces so the trace buffer cannot overflow */
+				if (count == JOYSTICK_BATCH_MAX)
 				{
-					case JS_EVENT_BUTTON:
-					{
-						if (js->type == 3)
-						{
-							if (event.number < 17)
-							{
-								inputs.buttons &= ~(1 << event.number);
-								inputs.buttons |= (event.value << event.number);
-							}
-						}
-						else
-						{
-							if (event.number < 14)
-							{
-								const unsigned int ds4_button_map[14] = { 15, 14, 13, 12, 10, 11, 8,
-								                                           9,  0,  3,  1,  2, 16, 17 };
-								
-								inputs.buttons &= ~(1 << ds4_button_map[event.number]);
-								inputs.buttons |= (event.value << ds4_button_map[event.number]);
-								
-								if (event.number < 12 && event.number != 6 && event.number != 7)
-								{
-									inputs.axes.buffer[ds4_button_map[event.number]] = event.value;
-								}
-							}
-						}
-						
-						break;
-					}
-					case JS_EVENT_AXIS:
-					{
-						if (js->type == 3)
-						{
-							if (event.number < 20 && (event.number <= 3 || event.number >= 8))
-							{
-								inputs.axes.buffer[(event.number < 8) ? event.number : event.number - 4] = event.value;
-							}
-						}
-						else
-						{
-							if (event.number < 8)
-							{
-								const unsigned int ds4_axis_map[6] = { 0, 1, 2, 8, 9, 3 };
-								
-								if (event.number == 6) /* DPAD Left/Right */
-								{
-									inputs.buttons &= ~(1 << 7); /* Left */
-									inputs.buttons |= (event.value < 0) << 7;
-									inputs.axes.buffer[7] = (event.value < 0);
-									inputs.buttons &= ~(1 << 5); /* Right */
-									inputs.buttons |= (event.value > 0) << 5;
-									inputs.axes.buffer[5] = (event.value > 0);
-								}
-								else if (event.number == 7) /* DPAD Up/Down */
-								{
-									inputs.buttons &= ~(1 << 4); /* Up */
-									inputs.buttons |= (event.value < 0) << 4;
-									inputs.axes.buffer[4] = (event.value < 0);
-									inputs.buttons &= ~(1 << 6); /* Down */
-									inputs.buttons |= (event.value > 0) << 6;
-									inputs.axes.buffer[6] = (event.value > 0);
-								}
-								else if (event.number == 3 || event.number == 4) /* L2/R2 */
-								{
-									inputs.axes.buffer[ds4_axis_map[event.number]] = event.value;
-								}
-								else /* Sticks */
-								{
-									inputs.axes.buffer[ds4_axis_map[event.number]] = event.value;
-								}
-							}
-						}
-						
-						break;
-					}
+					joystick_publish(js, &inputs, events, count);
+					count = 0;
 				}
 				
 				{
 					struct js_event tmp;
 					
+					start = stats_time();
+					
 					if (read(js->device, &tmp, sizeof(struct js_event)) == sizeof(struct js_event))
 					{
+						stats_record(&js->stats, STATS_EVENT_READ, stats_time() - start);
+						
 						if (tmp.time == event.time)
 						{
 							event = tmp;
@@ -163,16 +241,58 @@ static void *joystick_polling_thread(void *data)
 				break;
 			}
 			
-			pthread_mutex_lock(&js->inputs_mutex);
-			js->inputs = inputs;
-			pthread_mutex_unlock(&js->inputs_mutex);
+			joystick_publish(js, &inputs, events, count);
 		}
 	}
 	
 	return 0;
 }
 
-int joystick_init(const char *joystick_path, const char *event_path, joystick *js)
+/* Bluetooth input devices report the controller's address as their unique id
+	0 - success
+   -1 - no address (USB connections and devices outside /dev/input) */
+static int joystick_read_address(const char *joystick_path, uint8_t (*address)[6])
+{
+	char         path[128];
+	const char  *name = strrchr(joystick_path, '/');
+	unsigned int bytes[6];
+	unsigned int i, any = 0;
+	FILE        *file;
+	int          fields;
+	
+	name = name ? name + 1 : joystick_path;
+	
+	if (strlen(name) > 32)
+	{
+		return -1;
+	}
+	
+	sprintf(path, "/sys/class/input/%s/device/uniq", name);
+	
+	if (!(file = fopen(path, "r")))
+	{
+		return -1;
+	}
+	
+	fields = fscanf(file, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]);
+	
+	fclose(file);
+	
+	if (fields != 6)
+	{
+		return -1;
+	}
+	
+	for (i = 0; i < 6; i++)
+	{
+		(*address)[i] = (uint8_t)bytes[i];
+		any |= bytes[i];
+	}
+	
+	return any ? 0 : -1;
+}
+
+int joystick_init(const char *joystick_path, const char *event_path, const char *trace_path, joystick *js)
 {
 	memset(js, 0, sizeof(joystick));
 	
@@ -194,24 +314,19 @@ int joystick_init(const char *joystick_path, const char *event_path, joystick *j
 		js->type = (buttons == 14 && axes == 18) ? 4 : 3;
 	}
 	
-	/* Initialize button pressures -- Joystick thread reports 
-	   DS3 button pressure as -32767 to +32767 while
-	   DS4 pressures are reported as 0 or 1 (except L2/R2) */
-	if (js->type == 3)
+	joystick_init_inputs(js->type, &js->inputs);
+	
+	js->has_address = (joystick_read_address(joystick_path, &js->address) == 0);
+	
+	if (trace_path && trace_create(trace_path, js->type, &js->trace) == -1)
 	{
-		unsigned int i;
+		close(js->device);
 		
-		for (i = 4; i < 16; i++)
-		{
-			js->inputs.axes.buffer[i] = -32767;
-		}
-	}
-	else
-	{
-		js->inputs.axes.buffer[8] = -32767;
-		js->inputs.axes.buffer[9] = -32767;
+		return -1;
 	}
 	
+	stats_register(&js->stats);
+	
 	if (pthread_create(&js->thread, NULL, &joystick_polling_thread, (void *)js) != 0)
 	{
 		close(js->device);
@@ -0,0 +1,139 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* ftruncate() */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "live.h"
+
+#define LIVE_READ_ATTEMPTS 1000
+
+/* Full barrier - orders the data against the sequence on every core */
+#define LIVE_BARRIER() __sync_synchronize()
+
+live_state *live_create(const char *path)
+{
+	live_state *state;
+	int         fd;
+	
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+	{
+		return NULL;
+	}
+	
+	if (ftruncate(fd, sizeof(live_state)) == -1)
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	state = mmap(NULL, sizeof(live_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	
+	close(fd);
+	
+	if (state == MAP_FAILED)
+	{
+		return NULL;
+	}
+	
+	memset(state, 0, sizeof(live_state));
+	
+	state->version = LIVE_VERSION;
+	state->size = sizeof(live_state);
+	
+	/* The magic goes last so a monitor never accepts a half initialized file */
+	LIVE_BARRIER();
+	memcpy(state->magic, LIVE_MAGIC, sizeof(state->magic));
+	
+	return state;
+}
+
+live_state *live_open(const char *path)
+{
+	live_state *state;
+	struct stat info;
+	int         fd;
+	
+	if ((fd = open(path, O_RDONLY)) == -1)
+	{
+		return NULL;
+	}
+	
+	if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(live_state))
+	{
+		close(fd);
+		return NULL;
+	}
+	
+	state = mmap(NULL, sizeof(live_state), PROT_READ, MAP_SHARED, fd, 0);
+	
+	close(fd);
+	
+	if (state == MAP_FAILED)
+	{
+		return NULL;
+	}
+	
+	if (memcmp(state->magic, LIVE_MAGIC, sizeof(state->magic)) != 0
+	||  state->version != LIVE_VERSION || state->size != sizeof(live_state))
+	{
+		munmap(state, sizeof(live_state));
+		return NULL;
+	}
+	
+	return state;
+}
+
+void live_publish(live_state *state, const live_data *data)
+{
+	state->sequence++;
+	LIVE_BARRIER();
+	
+	memcpy(&state->data, data, sizeof(live_data));
+	
+	LIVE_BARRIER();
+	state->sequence++;
+}
+
+int live_read(live_state *state, live_data *data)
+{
+	unsigned int attempt;
+	
+	for (attempt = 0; attempt < LIVE_READ_ATTEMPTS; attempt++)
+	{
+		uint32_t sequence = state->sequence;
+		
+		if (sequence & 1)
+		{
+			continue;
+		}
+		
+		LIVE_BARRIER();
+		memcpy(data, &state->data, sizeof(live_data));
+		LIVE_BARRIER();
+		
+		if (state->sequence == sequence)
+		{
+			return 0;
+		}
+	}
+	
+	return -1;
+}
@@ -0,0 +1,209 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "phase.h"
+
+#define PHASE_PERIOD_MIN     ((int64_t)4000000)    /* 250Hz */
+#define PHASE_PERIOD_MAX     ((int64_t)50000000)   /* 20Hz */
+#define PHASE_TOLERANCE      ((int64_t)500000)     /* Maximum phase error while locked */
+#define PHASE_TIMEOUT        ((int64_t)1000000000) /* Lock is lost when the console stops polling */
+#define PHASE_LOCK_COUNT     8                     /* Observations within tolerance to gain lock */
+#define PHASE_UNLOCK_COUNT   4                     /* Observations outside of tolerance to lose lock */
+#define PHASE_RELEARN_COUNT  16                    /* Observations outside of tolerance to discard period */
+#define PHASE_MAX_SKIPPED    64                    /* Maximum number of unobserved polls between observations */
+
+static int64_t phase_abs(int64_t x)
+{
+	return (x < 0) ? -x : x;
+}
+
+static void phase_estimator_unlock(phase_estimator *est)
+{
+	est->locked = 0;
+	est->lock_count = 0;
+	est->miss_count = 0;
+	est->period = 0;
+	est->error = 0;
+	est->error_average = 0;
+}
+
+/*  - The loop is a second order alpha-beta filter on the predicted poll time
+	- Polls which were not observed (the Teensy reports only the most recent) are
+	  skipped over by rounding to the nearest whole number of periods */
+static void phase_estimator_observe(phase_estimator *est, int64_t poll)
+{
+	int64_t delta;
+	int64_t predicted;
+	int64_t n;
+	
+	if (!est->have_poll)
+	{
+		est->last_poll = poll;
+		est->have_poll = 1;
+		
+		return;
+	}
+	
+	delta = poll - est->last_poll;
+	
+	if (delta <= 0)
+	{
+		return;
+	}
+	
+	est->last_poll = poll;
+	
+	if (est->period == 0)
+	{
+		if (delta >= PHASE_PERIOD_MIN && delta <= PHASE_PERIOD_MAX)
+		{
+			est->period = delta;
+			est->phase = poll;
+		}
+		
+		return;
+	}
+	
+	n = (poll - est->phase + est->period / 2) / est->period;
+	
+	if (n < 1 || n > PHASE_MAX_SKIPPED)
+	{
+		phase_estimator_unlock(est);
+		
+		return;
+	}
+	
+	predicted = est->phase + n * est->period;
+	
+	est->error = poll - predicted;
+	est->phase = predicted + est->error / 2;
+	est->period += est->error / (16 * n);
+	est->error_average += (phase_abs(est->error) - est->error_average) / 8;
+	
+	if (est->period < PHASE_PERIOD_MIN || est->period > PHASE_PERIOD_MAX)
+	{
+		phase_estimator_unlock(est);
+		
+		return;
+	}
+	
+	if (phase_abs(est->error) <= PHASE_TOLERANCE)
+	{
+		est->miss_count = 0;
+		
+		if (++est->lock_count >= PHASE_LOCK_COUNT)
+		{
+			est->locked = 1;
+		}
+	}
+	else
+	{
+		est->lock_count = 0;
+		
+		if (++est->miss_count >= PHASE_UNLOCK_COUNT)
+		{
+			est->locked = 0;
+		}
+		
+		if (est->miss_count >= PHASE_RELEARN_COUNT)
+		{
+			phase_estimator_unlock(est);
+		}
+	}
+}
+
+void phase_estimator_init(phase_estimator *est)
+{
+	memset(est, 0, sizeof(phase_estimator));
+}
+
+/*  - The Teensy reports when the last poll began and how long ago that was on its own clock
+	- Its clock is mapped onto the local clock using the lowest latency packet seen so far
+	  which keeps USB scheduling jitter out of the poll times fed to the loop
+	- The offset is slowly allowed to rise so that drift between the clocks is followed */
+void phase_estimator_update(phase_estimator *est, int64_t now, uint8_t (*packet)[RECV_PACKET_SIZE])
+{
+	uint16_t poll_ticks;
+	uint16_t age_ticks;
+	uint16_t reply_ticks;
+	int64_t  poll;
+	
+	poll_ticks = (uint16_t)((*packet)[4] | ((*packet)[5] << 8));
+	age_ticks = (uint16_t)((*packet)[6] | ((*packet)[7] << 8));
+	reply_ticks = (uint16_t)(poll_ticks + age_ticks);
+	
+	if (!est->have_reply)
+	{
+		est->teensy_time = (int64_t)reply_ticks * SERIAL_POLL_TICK_NS;
+		est->offset = now - est->teensy_time;
+		est->have_reply = 1;
+	}
+	else
+	{
+		int64_t elapsed;
+		int64_t advance;
+		int64_t wrap;
+		
+		elapsed = now - est->reply_time;
+		advance = (int64_t)(uint16_t)(reply_ticks - est->reply_ticks) * SERIAL_POLL_TICK_NS;
+		wrap = (int64_t)65536 * SERIAL_POLL_TICK_NS;
+		
+		if (elapsed > advance) /* Timer wraps between packets are only visible in local time */
+		{
+			advance += ((elapsed - advance + wrap / 2) / wrap) * wrap;
+		}
+		
+		est->teensy_time += advance;
+		est->offset += elapsed / 4096;
+		
+		if (now - est->teensy_time < est->offset)
+		{
+			est->offset = now - est->teensy_time;
+		}
+	}
+	
+	est->reply_ticks = reply_ticks;
+	est->reply_time = now;
+	
+	poll = est->teensy_time - (int64_t)age_ticks * SERIAL_POLL_TICK_NS + est->offset;
+	
+	if (!est->have_poll || poll - est->last_poll > PHASE_PERIOD_MIN / 2)
+	{
+		phase_estimator_observe(est, poll);
+	}
+}
+
+/* -1 - not locked
+   !-1 - local time at which to send so the packet arrives guard nanoseconds before the next poll */
+int64_t phase_estimator_schedule(phase_estimator *est, int64_t now, int64_t guard)
+{
+	int64_t k;
+	
+	if (est->locked && now - est->last_poll > PHASE_TIMEOUT)
+	{
+		phase_estimator_unlock(est);
+	}
+	
+	if (!est->locked)
+	{
+		return -1;
+	}
+	
+	k = (now + guard - est->phase) / est->period + 1;
+	
+	return est->phase + k * est->period - guard;
+}
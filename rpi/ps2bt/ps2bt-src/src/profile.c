@@ -0,0 +1,251 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* ftruncate(), mmap(), msync() */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "profile.h"
+
+static uint32_t cfg_profile_checksum(const cfg_profile *profile)
+{
+	return cfg_cache_crc(&profile->source, sizeof(cfg_profile) - offsetof(cfg_profile, source));
+}
+
+/* Returns the slot holding address, the free slot where it belongs or NULL when the store is full
+	- Profiles are never removed so the probe ends at the first free slot */
+static cfg_profile *cfg_profile_slot(cfg_profile_file *file, const uint8_t *address)
+{
+	unsigned int hash = 2166136261U;
+	unsigned int slot;
+	unsigned int i;
+	
+	for (i = 0; i < 6; i++)
+	{
+		hash = ((hash ^ address[i]) * 16777619U) & 0xFFFFFFFFU;
+	}
+	
+	slot = hash & (CFG_PROFILE_SLOTS - 1);
+	
+	for (i = 0; i < CFG_PROFILE_SLOTS; i++, slot = (slot + 1) & (CFG_PROFILE_SLOTS - 1))
+	{
+		cfg_profile *profile = &file->slots[slot];
+		
+		if (!profile->used || !memcmp(profile->address, address, sizeof(profile->address)))
+		{
+			return profile;
+		}
+	}
+	
+	return NULL;
+}
+
+/* Must be called with the mutex held
+	- leds are the colors saved on the controller, NULL when none are */
+static void cfg_profile_store_locked(cfg_profile_store *store, const uint8_t *address,
+                                     const cfg_cache_stamp *source, const uint8_t *leds,
+                                     const cfg_settings *settings)
+{
+	cfg_profile *profile = cfg_profile_slot(store->map, address);
+	
+	/* A full store only costs the new controller a parse on every connection */
+	if (!profile)
+	{
+		return;
+	}
+	
+	memcpy(profile->address, address, sizeof(profile->address));
+	profile->source = *source;
+	
+	if (leds)
+	{
+		memcpy(profile->ds4_leds, leds, sizeof(profile->ds4_leds));
+	}
+	
+	profile->leds_saved = (leds != NULL);
+	memcpy(&profile->settings, settings, sizeof(cfg_settings));
+	profile->crc = cfg_profile_checksum(profile);
+	profile->used = 1;
+	
+	msync(store->map, sizeof(cfg_profile_file), MS_SYNC);
+}
+
+int cfg_profile_open(const char *path, const char *ro_path, const char *rw_path, const char *cache_path,
+                     cfg_profile_store *store)
+{
+	struct stat info;
+	void       *map;
+	int         fd;
+	int         valid;
+	
+	memset(store, 0, sizeof(cfg_profile_store));
+	
+	store->ro_path = ro_path;
+	store->rw_path = rw_path;
+	store->cache_path = cache_path;
+	
+	pthread_mutex_init(&store->mutex, NULL);
+	
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) == -1)
+	{
+		return -1;
+	}
+	
+	if (fstat(fd, &info) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	valid = (info.st_size == (off_t)sizeof(cfg_profile_file));
+	
+	if (!valid && ftruncate(fd, sizeof(cfg_profile_file)) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	map = mmap(NULL, sizeof(cfg_profile_file), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	
+	close(fd);
+	
+	if (map == MAP_FAILED)
+	{
+		return -1;
+	}
+	
+	store->map = (cfg_profile_file *)map;
+	
+	if (!valid
+	||  memcmp(store->map->magic, CFG_PROFILE_MAGIC, sizeof(store->map->magic))
+	||  store->map->version != CFG_PROFILE_VERSION
+	||  store->map->length != sizeof(cfg_profile))
+	{
+		memset(store->map, 0, sizeof(cfg_profile_file));
+		
+		memcpy(store->map->magic, CFG_PROFILE_MAGIC, sizeof(store->map->magic));
+		store->map->version = CFG_PROFILE_VERSION;
+		store->map->length = sizeof(cfg_profile);
+		
+		msync(store->map, sizeof(cfg_profile_file), MS_SYNC);
+	}
+	
+	return 0;
+}
+
+void cfg_profile_close(cfg_profile_store *store)
+{
+	if (store->map)
+	{
+		munmap(store->map, sizeof(cfg_profile_file));
+		store->map = NULL;
+	}
+	
+	pthread_mutex_destroy(&store->mutex);
+}
+
+void cfg_profile_load(cfg_profile_store *store, const uint8_t *address, cfg_settings *settings)
+{
+	cfg_cache_stamp source;
+	cfg_profile    *profile;
+	uint8_t         leds[3];
+	int             leds_saved;
+	char            text[18];
+	
+	/* Every pipeline loads through the same cache, which is rewritten through a temporary file
+	   of a fixed name, so a load holds the mutex even when it has to parse */
+	pthread_mutex_lock(&store->mutex);
+	
+	if (!store->map || !address)
+	{
+		cfg_cache_load(store->ro_path, store->rw_path, store->cache_path, settings);
+		pthread_mutex_unlock(&store->mutex);
+		return;
+	}
+	
+	/* Stamped before parsing so a file changed during the parse leaves the profile stale */
+	cfg_cache_stamp_file(store->ro_path, &source);
+	
+	profile = cfg_profile_slot(store->map, address);
+	
+	leds_saved = 0;
+	
+	if (profile && profile->used && profile->crc == cfg_profile_checksum(profile))
+	{
+		if (!memcmp(&profile->source, &source, sizeof(source)))
+		{
+			memcpy(settings, &profile->settings, sizeof(cfg_settings));
+			pthread_mutex_unlock(&store->mutex);
+			return;
+		}
+		
+		/* Only the compiled settings are stale - the controller keeps its own colors */
+		if ((leds_saved = profile->leds_saved))
+		{
+			memcpy(leds, profile->ds4_leds, sizeof(leds));
+		}
+	}
+	
+	cfg_cache_load(store->ro_path, store->rw_path, store->cache_path, settings);
+	
+	sprintf(text, "%02x:%02x:%02x:%02x:%02x:%02x", (unsigned int)address[0], (unsigned int)address[1],
+	        (unsigned int)address[2], (unsigned int)address[3], (unsigned int)address[4], (unsigned int)address[5]);
+	
+	cfg_file_read_address(store->ro_path, text, settings);
+	
+	if (leds_saved)
+	{
+		memcpy(settings->ds4_leds, leds, sizeof(leds));
+	}
+	
+	cfg_profile_store_locked(store, address, &source, leds_saved ? leds : NULL, settings);
+	
+	pthread_mutex_unlock(&store->mutex);
+}
+
+void cfg_profile_save(cfg_profile_store *store, const uint8_t *address, const cfg_settings *settings)
+{
+	cfg_profile    *profile;
+	cfg_cache_stamp source;
+	
+	pthread_mutex_lock(&store->mutex);
+	
+	if (!store->map || !address)
+	{
+		cfg_file_write(store->rw_path, settings);
+		pthread_mutex_unlock(&store->mutex);
+		return;
+	}
+	
+	/* The settings still come from the same files so the profile keeps its stamp */
+	if ((profile = cfg_profile_slot(store->map, address)) && profile->used)
+	{
+		source = profile->source;
+	}
+	else
+	{
+		cfg_cache_stamp_file(store->ro_path, &source);
+	}
+	
+	cfg_profile_store_locked(store, address, &source, settings->ds4_leds, settings);
+	
+	pthread_mutex_unlock(&store->mutex);
+}
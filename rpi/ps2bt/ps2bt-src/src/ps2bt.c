@@ -14,7 +14,7 @@
  * GNU General Public License for more details.
  */
 
-#define _POSIX_C_SOURCE 199309L /* nanosleep() */
+#define _GNU_SOURCE /* getopt(), pthread_attr_setaffinity_np() */
 
 #include <stdint.h>
 #include <stdio.h>
@@ -22,162 +22,573 @@
 #include <string.h>
 #include <stddef.h>
 #include <math.h>
-#include <time.h>
 #include <errno.h>
+#include <sched.h>
 #include <unistd.h>
 #include <pthread.h>
-#include <sys/time.h>
+#include "cache.h"
 #include "cfg.h"
+#include "clock.h"
 #include "controller.h"
 #include "joystick.h"
 #include "led.h"
+#include "live.h"
+#include "phase.h"
+#include "profile.h"
 #include "rumble.h"
 #include "serial.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
+#include "watch.h"
+#include "writer.h"
 
-/* This macro function is usually defined by _BSD_SOURCE */
-#define timersub(a, b, result)                     \
-do {                                               \
-  (result)->tv_sec = (a)->tv_sec - (b)->tv_sec;    \
-  (result)->tv_usec = (a)->tv_usec - (b)->tv_usec; \
-  if ((result)->tv_usec < 0) {                     \
-    --(result)->tv_sec;                            \
-    (result)->tv_usec += 1000000;                  \
-  }                                                \
-} while (0)
+#ifndef MAX_RATE
+#define MAX_RATE 1000 /* Loop rate without frame_sync - can be set at build time */
+#endif
 
-#define MAX_RATE 1000
+#define PIPELINES_MAX 4 /* Controllers one process drives */
 
-#define DS3_HOLD_INTERVAL  2.0
-#define DS3_BLINK_INTERVAL 0.5
-#define DS4_BLINK_INTERVAL 0.3
+#define DS3_HOLD_INTERVAL  ((int64_t)2000000000)
+#define DS3_BLINK_INTERVAL ((int64_t)500000000)
+#define DS4_BLINK_INTERVAL ((int64_t)300000000)
 
-#define RO_SETTINGS_FILE "/tmp/settings.cfg"
-#define RW_SETTINGS_FILE "/var/lib/bluetooth/ds4.cfg"
+#define UI_TIMER_HOLD  0
+#define UI_TIMER_BLINK 1
 
-void nsleep(unsigned long nsec);
+#define RO_SETTINGS_FILE    "/tmp/settings.cfg"
+#define RW_SETTINGS_FILE    "/var/lib/bluetooth/ds4.cfg"
+#define CACHE_SETTINGS_FILE "/var/lib/bluetooth/ds4.cache" /* Compiled from both settings files */
+#define PROFILE_FILE        "/var/lib/bluetooth/ds4.profiles" /* Compiled settings of each controller */
 
-void apply_controller_map(unsigned int mode, controller_inputs *in, controller_inputs *out,
+/* Interaction state of one controller
+	- Owned by its pipeline so the handlers keep nothing between frames themselves */
+typedef struct
+{
+	timer_wheel     timers;                /* Hold and blink timers */
+	timer           hold_timer;
+	timer           blink_timer;
+	stats_set      *stats;                 /* Timings of the thread running the frames */
+	int64_t         remap_duration;        /* Time in apply_controller_map() during the current handler
+	                                          so it can be taken out of the handler's */
+	unsigned int    initialized;           /* Cleared until the first frame has been handled */
+	unsigned int    controller_map_mode;   /* 0 == Normal, 1 == Analog->DPAD, 2 == Custom */
+	int             hold_state;            /* DS3 - progress of a PS button hold */
+	unsigned int    blink_state;           /* DS4 - Number of LED blink periods to run - zero when not blinking */
+	unsigned int    blink_periods;         /* DS4 - Periods elapsed so far */
+	joystick_inputs previous;              /* DS4 - Inputs of the previous frame */
+	unsigned int    color_set_mode;
+	uint8_t         saved_leds[3];
+	uint8_t         emulated_pressure;
+	unsigned int    analog_emulated_range;
+} ui_state;
+
+/* Teensy driven by the pipelines given the same serial device
+	- Each of them addresses its own slot of the emulated multitap
+	- A pipeline holds the mutex from sending its packet until it has read its reply so a
+	  late reply for one slot is never mistaken for the next packet's
+	- A reply which misses its frame anyway is discarded by whichever pipeline sends next */
+typedef struct
+{
+	const char       *path;
+	int               device;
+	unsigned int      slots;        /* Slots handed out so far */
+	unsigned int      change_only;  /* Built with REPLY_ON_CHANGE_ONLY (-c) */
+	unsigned int      reply_missed; /* The last packet sent got no reply in time */
+	pthread_mutex_t   mutex;
+} teensy;
+
+/* One controller to Teensy pipeline
+	- Each runs its frame loop on its own thread and shares nothing with the others
+	  but the profile store, which has its own mutex, and its Teensy
+	- The first pipeline uses the usual live state file and trace path, the others
+	  append their number so a single controller sees no difference */
+typedef struct
+{
+	unsigned int      index;
+	teensy           *teensy;
+	unsigned int      slot;
+	joystick          js;
+	cfg_settings      settings;
+	uint8_t           leds[4];
+	ui_state          ui;
+	phase_estimator   phase;
+	live_state       *live_shared;
+	live_data         live;
+	cfg_watch         watch;
+	cfg_settings     *reload;  /* Settings from the watcher waiting for the UI to be idle */
+	cfg_writer        writer;
+	stats_set         stats;
+	const uint8_t    *address;
+	pthread_t         thread;
+} pipeline;
+
+teensy       *teensy_attach(teensy *teensies, unsigned int *count, const char *path, unsigned int *slot);
+
+char         *pipeline_path(const char *path, unsigned int index);
+void          pipeline_init(pipeline *p, unsigned int index, char **paths, const char *record_path,
+                            teensy *teensies, unsigned int *teensy_count, cfg_profile_store *profiles);
+void          pipeline_pin(pipeline *p, unsigned int count, pthread_attr_t *attr);
+unsigned int  pipeline_reload(pipeline *p);
+void         *pipeline_run(void *data);
+
+void         ui_state_init(ui_state *ui, int64_t now, stats_set *stats);
+void         init_leds(unsigned int type, cfg_settings *settings, uint8_t (*leds)[4]);
+unsigned int process_inputs(ui_state *ui, int64_t now, unsigned int type, joystick_inputs *input,
+                            cfg_settings *settings, uint8_t (*leds)[4], unsigned int *led_explicit_mode,
+                            controller_inputs *output, uint8_t (*packet)[SEND_PACKET_SIZE]);
+int          replay(const char *trace_path, int fast);
+
+void apply_controller_map(ui_state *ui, unsigned int mode, controller_inputs *in, controller_inputs *out,
                           controller_map *custom_map, uint8_t default_pressure, uint8_t deadzone);
 
-void ds3_handle_interaction_and_settings(joystick_inputs *in, controller_inputs *out,
+void ds3_handle_interaction_and_settings(ui_state *ui, int64_t now, joystick_inputs *in, controller_inputs *out,
                                          cfg_settings *settings, uint8_t *led, unsigned int *mode_switch);
 
 void         ds4_range_adjust(int16_t *x_inout, int16_t *y_inout, double divisor);
-unsigned int ds4_handle_interaction_and_settings(joystick_inputs *in, controller_inputs *out,
-                                                 cfg_settings *settings, uint8_t (*leds)[4],
-                                                 unsigned int *led_explicit_mode, unsigned int *mode_switch);
+unsigned int ds4_handle_interaction_and_settings(ui_state *ui, int64_t now, joystick_inputs *in,
+                                                 controller_inputs *out, cfg_settings *settings,
+                                                 uint8_t (*leds)[4], unsigned int *led_explicit_mode,
+                                                 unsigned int *mode_switch);
 
 int main(int argc, char **argv)
 {
-	int          serial_device;
-	joystick     js;
-	cfg_settings settings;
-	uint8_t      leds[4];
-	
-	#ifdef BENCHMARK
-		const unsigned int benchmark_sample_size = 30;
-		unsigned int       benchmark_frame_counter = 0;
-		double             benchmark_sample_time = 0;
-		struct timeval     benchmark_frame_start;
-		struct timeval     benchmark_frame_end;
-	#endif
-	
-	if (argc != 4)
-	{
-		printf("\nUsage: %s <joystick device> <event device> <serial device>\n\n", argv[0]);
+	pipeline         *pipelines;
+	teensy            teensies[PIPELINES_MAX];
+	cfg_profile_store profiles;
+	const char       *record_path = NULL;
+	const char       *replay_path = NULL;
+	unsigned int      count;
+	unsigned int      teensy_count = 0;
+	unsigned int      i;
+	int               change_only = 0;
+	int               fast = 0;
+	int               usage = 0;
+	int               opt;
+	
+	while ((opt = getopt(argc, argv, "r:p:fc")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': record_path = optarg; break;
+			case 'p': replay_path = optarg; break;
+			case 'f': fast = 1;             break;
+			case 'c': change_only = 1;      break;
+			default:  usage = 1;            break;
+		}
+	}
+	
+	if (!usage && replay_path && optind == argc)
+	{
+		exit(replay(replay_path, fast) == -1);
+	}
+	
+	count = (unsigned int)(argc - optind) / 3;
+	
+	if (usage || replay_path || fast || !count || count > PIPELINES_MAX || (argc - optind) % 3)
+	{
+		printf("\nUsage: %s [-r <trace file>] [-c] <joystick device> <event device> <serial device> [...]\n", argv[0]);
+		printf("       %s -p <trace file> [-f]\n\n", argv[0]);
+		printf("  Up to %d controllers, each given as its joystick, event and serial devices\n", PIPELINES_MAX);
+		printf("  Controllers given the same serial device share its Teensy through the multitap\n\n");
+		printf("  -r  Record the input consumed by every frame - controllers after the first\n");
+		printf("      record to <trace file>.2, <trace file>.3 and so on\n");
+		printf("  -c  The Teensy is built with REPLY_ON_CHANGE_ONLY - a missing reply means nothing changed\n");
+		printf("  -p  Replay a recording through the frame pipeline and check every packet\n");
+		printf("  -f  Replay as fast as possible instead of in real time\n\n");
 		exit(0);
 	}
 	
-	if ((serial_device = serial_init(argv[3])) == -1)
+	if (!(pipelines = calloc(count, sizeof(pipeline))))
 	{
-		fprintf(stderr, "Error opening %s: %s\n", argv[3], strerror(errno));
+		fprintf(stderr, "Out of memory\n");
 		exit(1);
 	}
 	
-	if (joystick_init(argv[1], argv[2], &js) == -1)
+	/* Without the store every controller uses the shared settings */
+	if (cfg_profile_open(PROFILE_FILE, RO_SETTINGS_FILE, RW_SETTINGS_FILE, CACHE_SETTINGS_FILE, &profiles) == -1)
+	{
+		fprintf(stderr, "Error opening %s: %s\n", PROFILE_FILE, strerror(errno));
+	}
+	
+	for (i = 0; i < count; i++)
+	{
+		pipeline_init(&pipelines[i], i, &argv[optind + i * 3], record_path, teensies, &teensy_count, &profiles);
+	}
+	
+	for (i = 0; i < teensy_count; i++)
+	{
+		teensies[i].change_only = change_only;
+	}
+	
+	if (stats_start(STATS_FILE) == -1)
 	{
-		fprintf(stderr, "Failed to initialize controller\n");
+		fprintf(stderr, "Failed to start the stats thread\n");
 		exit(1);
 	}
 	
-	cfg_file_read(RO_SETTINGS_FILE, RW_SETTINGS_FILE, &settings);
+	for (i = 0; i < count; i++)
+	{
+		pthread_attr_t attr;
+		
+		pthread_attr_init(&attr);
+		
+		/* Pinned before it starts so no frame runs on another core first */
+		pipeline_pin(&pipelines[i], count, &attr);
+		
+		if (pthread_create(&pipelines[i].thread, &attr, &pipeline_run, (void *)&pipelines[i]) != 0)
+		{
+			fprintf(stderr, "Failed to start pipeline %u\n", i + 1);
+			exit(1);
+		}
+		
+		pthread_attr_destroy(&attr);
+	}
+	
+	/* A pipeline ends when its controller disconnects - ps2bt exits once all of them have */
+	for (i = 0; i < count; i++)
+	{
+		pthread_join(pipelines[i].thread, NULL);
+	}
+	
+	exit(0);
+}
+
+/* Returns the Teensy on path, opened on first use, and the next free multitap slot on it
+	- NULL on error */
+teensy *teensy_attach(teensy *teensies, unsigned int *count, const char *path, unsigned int *slot)
+{
+	teensy      *t;
+	unsigned int i;
 	
-	if (js.type == 3)
+	for (i = 0; i < *count; i++)
 	{
-		leds[0] = settings.ds3_leds[0];
-		leds[1] = settings.ds3_leds[1];
-		leds[2] = 0;
-		leds[3] = 0;
+		if (!strcmp(teensies[i].path, path))
+		{
+			break;
+		}
+	}
+	
+	t = &teensies[i];
+	
+	if (i == *count)
+	{
+		if ((t->device = serial_init(path)) == -1)
+		{
+			fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+			return NULL;
+		}
+		
+		t->path = path;
+		t->slots = 0;
+		t->change_only = 0;
+		t->reply_missed = 0;
+		pthread_mutex_init(&t->mutex, NULL);
+		
+		(*count)++;
+	}
+	
+	if (t->slots == SERIAL_SLOTS)
+	{
+		fprintf(stderr, "Too many controllers on %s\n", path);
+		return NULL;
+	}
+	
+	*slot = t->slots++;
+	
+	return t;
+}
+
+/* NULL on error - otherwise the path for pipeline index which the caller must free() */
+char *pipeline_path(const char *path, unsigned int index)
+{
+	char *result;
+	
+	if (!(result = malloc(strlen(path) + 12)))
+	{
+		return NULL;
+	}
+	
+	if (index)
+	{
+		sprintf(result, "%s.%u", path, index + 1);
 	}
 	else
 	{
-		leds[0] = settings.ds4_leds[DS4_LED_RED];
-		leds[1] = settings.ds4_leds[DS4_LED_GREEN];
-		leds[2] = settings.ds4_leds[DS4_LED_BLUE];
-		leds[3] = 1;
+		strcpy(result, path);
+	}
+	
+	return result;
+}
+
+/* Opens the devices of one controller and loads its settings - exits on errors as ps2bt always has
+	- paths holds the joystick, event and serial device */
+void pipeline_init(pipeline *p, unsigned int index, char **paths, const char *record_path,
+                   teensy *teensies, unsigned int *teensy_count, cfg_profile_store *profiles)
+{
+	char *trace_path = NULL;
+	char *live_path;
+	
+	p->index = index;
+	
+	if (!(p->teensy = teensy_attach(teensies, teensy_count, paths[2], &p->slot)))
+	{
+		exit(1);
+	}
+	
+	if ((record_path && !(trace_path = pipeline_path(record_path, index)))
+	||  joystick_init(paths[0], paths[1], trace_path, &p->js) == -1)
+	{
+		fprintf(stderr, "Failed to initialize controller %u\n", index + 1);
+		exit(1);
+	}
+	
+	free(trace_path);
+	
+	p->address = p->js.has_address ? p->js.address : NULL;
+	
+	cfg_profile_load(profiles, p->address, &p->settings);
+	
+	/* Without the watcher settings changes only apply on the next connection */
+	if (cfg_watch_start(profiles, p->address, &p->watch) == -1)
+	{
+		fprintf(stderr, "Error watching settings files: %s\n", strerror(errno));
+	}
+	
+	/* The frame loop never writes files itself */
+	if (cfg_writer_start(profiles, p->address, &p->writer) == -1)
+	{
+		fprintf(stderr, "Failed to start writer threads\n");
+		exit(1);
+	}
+	
+	init_leds(p->js.type, &p->settings, &p->leds);
+	
+	phase_estimator_init(&p->phase);
+	
+	stats_register(&p->stats);
+	
+	/* Monitors are optional so ps2bt runs without them when the file cannot be created */
+	if (!(live_path = pipeline_path(LIVE_FILE, index)) || !(p->live_shared = live_create(live_path)))
+	{
+		fprintf(stderr, "Error creating live state file %u: %s\n", index + 1, strerror(errno));
+	}
+	
+	free(live_path);
+	
+	memset(&p->live, 0, sizeof(p->live));
+	p->live.type = p->js.type;
+}
+
+/* Sets attr to pin the frame loop of each pipeline to a core of its own
+	- Cores are handed out from the last one down because the Pi takes its USB and Bluetooth
+	  interrupts on core 0, which is only used once every other core has a pipeline
+	- A pipeline which cannot be pinned keeps running wherever the scheduler puts it */
+void pipeline_pin(pipeline *p, unsigned int count, pthread_attr_t *attr)
+{
+	cpu_set_t set;
+	long      cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int       error;
+	
+	if (cores < 2 || count > (unsigned int)cores)
+	{
+		return;
 	}
 	
-	#ifdef BENCHMARK
-		printf("\n\nBegin polling loop\n");
-		fflush(stdout);
-	#endif
+	CPU_ZERO(&set);
+	CPU_SET((int)(cores - 1 - (long)p->index), &set);
+	
+	if ((error = pthread_attr_setaffinity_np(attr, sizeof(set), &set)) != 0)
+	{
+		fprintf(stderr, "Failed to pin pipeline %u: %s\n", p->index + 1, strerror(error));
+	}
+}
+
+/* Swaps in settings reparsed by the watcher - returns non-zero when it did
+	- Held back while an interaction owns the LEDs (a DS3 hold or a DS4 blink or color set)
+	  so init_leds() never cuts it short - a newer reparse replaces the one held back
+	- The DS4 colors are kept from memory as they belong to the running controller, which
+	  may have set one in color set mode that the writer has not saved yet */
+unsigned int pipeline_reload(pipeline *p)
+{
+	cfg_settings *reloaded;
+	ui_state     *ui = &p->ui;
+	
+	if ((reloaded = cfg_watch_take(&p->watch)))
+	{
+		free(p->reload);
+		p->reload = reloaded;
+	}
+	
+	if (!p->reload || ui->hold_state || ui->blink_state || ui->blink_timer.armed || ui->color_set_mode)
+	{
+		return 0;
+	}
+	
+	memcpy(p->reload->ds4_leds, p->settings.ds4_leds, sizeof(p->settings.ds4_leds));
+	
+	p->settings = *p->reload;
+	free(p->reload);
+	p->reload = NULL;
+	
+	init_leds(p->js.type, &p->settings, &p->leds);
+	
+	return 1;
+}
+
+void *pipeline_run(void *data)
+{
+	pipeline    *p = (pipeline *)data;
+	joystick    *js = &p->js;
+	int64_t      frame_start = 0;
+	unsigned int settings_swapped = 1; /* The first frame records the settings it starts with */
 	
 	while (1)
 	{
 		uint8_t           tx_packet[SEND_PACKET_SIZE];
 		uint8_t           rx_packet[RECV_PACKET_SIZE];
 		joystick_inputs   input;
-		controller_inputs output;
 		unsigned int      led_explicit_mode;
-		unsigned int      mode_switch;
+		unsigned int      save_settings = 0;
+		int               received;
+		int64_t           now;
+		int64_t           start;
 		
-		#ifdef BENCHMARK
-			gettimeofday(&benchmark_frame_start, NULL);
-		#endif
+		/* The clock is read once per frame and shared by the UI timers, the trace and the scheduler
+		   - The only other read is the arrival time of a reply which the phase estimator needs
+		   - Stage timings for the stats are measured separately with stats_time() */
+		now = clock_now();
 		
-		pthread_mutex_lock(&js.inputs_mutex);
-		input = js.inputs;
-		pthread_mutex_unlock(&js.inputs_mutex);
+		/* While recording frame times are whole microseconds, as the trace stores them,
+		   so a replay runs every frame at exactly its captured time */
+		if (js->trace.file)
+		{
+			now -= now % 1000;
+		}
 		
-		if (js.thread_terminated)
+		p->live.time = now;
+		
+		/* The UI starts with the first frame so a replay can start it at the same time */
+		if (!frame_start)
 		{
-			pthread_join(js.thread, NULL);
-			serial_send_disconnect_packet(serial_device);
-			exit(0);
+			ui_state_init(&p->ui, now, &p->stats);
 		}
 		
-		if (js.type == 3)
+		start = stats_time();
+		
+		if (frame_start)
 		{
-			ds3_handle_interaction_and_settings(&input, &output, &settings, &leds[2], &mode_switch);
+			stats_record(&p->stats, STATS_FRAME, start - frame_start);
 		}
-		else
+		
+		frame_start = start;
+		
+		/* Settings reparsed by the watcher are swapped in between frames */
+		if (pipeline_reload(p))
 		{
-			if (ds4_handle_interaction_and_settings(&input, &output,
-			                                        &settings, &leds, &led_explicit_mode, &mode_switch))
+			settings_swapped = 1;
+		}
+		
+		pthread_mutex_lock(&js->inputs_mutex);
+		input = js->inputs;
+		
+		/* While recording the frame is processed under the lock so no event
+		   can be traced between the inputs it sampled and its frame record */
+		if (js->trace.file)
+		{
+			if (settings_swapped)
 			{
-				cfg_file_write(RW_SETTINGS_FILE, &settings);
+				trace_write_settings(&js->trace, now, &p->settings);
 			}
+			
+			save_settings = process_inputs(&p->ui, now, js->type, &input, &p->settings, &p->leds,
+			                               &led_explicit_mode, &p->live.controller, &tx_packet);
+			trace_write_frame(&js->trace, now, &tx_packet);
 		}
 		
-		serial_construct_packet(&output, &tx_packet, mode_switch);
+		pthread_mutex_unlock(&js->inputs_mutex);
+		
+		settings_swapped = 0;
+		
+		if (js->thread_terminated)
+		{
+			pthread_join(js->thread, NULL);
+			free(p->reload);
+			pthread_mutex_lock(&p->teensy->mutex);
+			serial_send_disconnect_packet(p->teensy->device, p->slot);
+			pthread_mutex_unlock(&p->teensy->mutex);
+			trace_close(&js->trace);
+			cfg_writer_stop(&p->writer);
+			return NULL;
+		}
 		
-		if (serial_send_packet(serial_device, &tx_packet) == -1)
+		if (!js->trace.file)
+		{
+			save_settings = process_inputs(&p->ui, now, js->type, &input, &p->settings, &p->leds,
+			                               &led_explicit_mode, &p->live.controller, &tx_packet);
+		}
+		
+		if (save_settings)
+		{
+			cfg_writer_request(&p->writer, &p->settings);
+		}
+		
+		pthread_mutex_lock(&p->teensy->mutex);
+		
+		/* Otherwise a reply which missed its frame would be read as this packet's */
+		if (p->teensy->reply_missed && serial_discard_replies(p->teensy->device) == -1)
+		{
+			exit(1);
+		}
+		
+		start = stats_time();
+		
+		if (serial_send_packet(p->teensy->device, p->slot, &tx_packet) == -1)
 		{
 			exit(1);
 		}
 		
-		if (!serial_recv_packet(serial_device, &rx_packet) == -1)
+		stats_record(&p->stats, STATS_SERIAL_WRITE, stats_time() - start);
+		
+		start = stats_time();
+		
+		if ((received = serial_recv_packet(p->teensy->device, p->slot, &rx_packet,
+		                                   p->teensy->change_only ? SERIAL_RECV_CHANGE_ONLY_TIMEOUT_MS
+		                                                          : SERIAL_RECV_TIMEOUT_MS)) == -1)
 		{
 			exit(1);
 		}
 		
-		if (rx_packet[0] == 0x5A)
+		stats_record(&p->stats, STATS_REPLY_READ, stats_time() - start);
+		
+		p->teensy->reply_missed = !received && !p->teensy->change_only;
+		
+		pthread_mutex_unlock(&p->teensy->mutex);
+		
+		/* No reply means the motors and mode LED are unchanged - nothing changed or the reply was late */
+		if (received)
 		{
-			if (js.led_support)
+			p->live.replies++;
+			memcpy(p->live.reply, rx_packet, RECV_PACKET_SIZE);
+			
+			now = clock_now();
+			
+			phase_estimator_update(&p->phase, now, &rx_packet);
+			
+			/* The stats file has room for one frame_sync state - the first controller's */
+			if (!p->index)
 			{
-				if (js.type == 3)
+				stats_sync(p->phase.locked, p->phase.period, p->phase.error_average);
+			}
+			
+			start = stats_time();
+			
+			if (js->led_support)
+			{
+				if (js->type == 3)
 				{
-					led_ds3_set(&js.led_devices, &js.led_values, leds[0], leds[1], leds[2], (rx_packet[3] == 0xAA));
+					led_ds3_set(&js->led_devices, &js->led_values, p->leds[0], p->leds[1], p->leds[2],
+					            (rx_packet[3] == 0xAA));
 				}
 				else
 				{
@@ -185,54 +596,239 @@ int main(int argc, char **argv)
 					
 					divisor = led_explicit_mode ? 1 : ((rx_packet[3] == 0xAA) ? 1 : 4);
 					
-					led_ds4_set(&js.led_devices, &js.led_values,
-					            leds[0] / divisor, leds[1] / divisor, leds[2] / divisor, leds[3]);
+					led_ds4_set(&js->led_devices, &js->led_values,
+					            p->leds[0] / divisor, p->leds[1] / divisor, p->leds[2] / divisor, p->leds[3]);
 				}
 			}
 			
-			if (js.rumble_support)
+			if (js->rumble_support)
 			{
-				rumble_set(js.rumble_device, &js.rumble_motors, rx_packet[2], rx_packet[1]);
+				rumble_set(js->rumble_device, &js->rumble_motors, rx_packet[2], rx_packet[1]);
 			}
+			
+			stats_record(&p->stats, STATS_OUTPUT, stats_time() - start);
 		}
 		
-		nsleep((unsigned long)(((double)1.0 / (double)MAX_RATE) * (double)1000000000.0));
+		p->live.frames++;
+		p->live.timeouts += !received;
+		p->live.sync_locked = p->phase.locked;
+		p->live.sync_period = p->phase.period;
+		p->live.sync_error = p->phase.error_average;
+		p->live.joystick = input;
+		memcpy(p->live.packet, tx_packet, SEND_PACKET_SIZE);
 		
-		#ifdef BENCHMARK
+		if (p->live_shared)
 		{
-			double benchmark_elapsed;
-			
-			gettimeofday(&benchmark_frame_end, NULL);
-			
-			benchmark_elapsed  = (double)(benchmark_frame_end.tv_sec - benchmark_frame_start.tv_sec);
-			benchmark_elapsed += (double)(benchmark_frame_end.tv_usec - benchmark_frame_start.tv_usec) / 1000000.0;
+			live_publish(p->live_shared, &p->live);
+		}
+		
+		/* When the console's poll timing is known send the next update just before the next poll
+		   otherwise fall back to polling at a fixed rate */
+		{
+			int64_t deadline = -1;
 			
-			benchmark_sample_time += benchmark_elapsed;
+			if (p->settings.frame_sync)
+			{
+				deadline = phase_estimator_schedule(&p->phase, now,
+				                                    (int64_t)p->settings.frame_sync_guard * 1000);
+			}
 			
-			if ((++benchmark_frame_counter % benchmark_sample_size) == 0)
+			if (deadline != -1)
 			{
-				printf("Average %05.1fFPS | Sample %05.2fms\r",
-				       1.0 / (benchmark_sample_time / benchmark_sample_size), benchmark_elapsed * 1000.0);
-				fflush(stdout);
-				benchmark_sample_time = 0;
-				benchmark_frame_counter = 0;
+				clock_sleep_until(deadline);
+			}
+			else
+			{
+				clock_sleep((int64_t)1000000000 / MAX_RATE);
 			}
 		}
-		#endif
 	}
 }
 
-void nsleep(unsigned long nsec)
+void ui_state_init(ui_state *ui, int64_t now, stats_set *stats)
 {
-	struct timespec t;
-	t.tv_sec = nsec / 1000000000L;
-	t.tv_nsec = nsec % 1000000000L;
-	while (nanosleep(&t, &t) != 0) continue;
+	memset(ui, 0, sizeof(ui_state));
+	
+	ui->stats = stats;
+	
+	timer_wheel_init(&ui->timers, now);
+	timer_init(&ui->hold_timer, UI_TIMER_HOLD);
+	timer_init(&ui->blink_timer, UI_TIMER_BLINK);
+}
+
+void init_leds(unsigned int type, cfg_settings *settings, uint8_t (*leds)[4])
+{
+	if (type == 3)
+	{
+		(*leds)[0] = settings->ds3_leds[0];
+		(*leds)[1] = settings->ds3_leds[1];
+		(*leds)[2] = 0;
+		(*leds)[3] = 0;
+	}
+	else
+	{
+		(*leds)[0] = settings->ds4_leds[DS4_LED_RED];
+		(*leds)[1] = settings->ds4_leds[DS4_LED_GREEN];
+		(*leds)[2] = settings->ds4_leds[DS4_LED_BLUE];
+		(*leds)[3] = 1;
+	}
 }
 
-void apply_controller_map(unsigned int mode, controller_inputs *in, controller_inputs *out,
+/* Runs one frame of the pipeline from joystick inputs to the serial packet
+	- Returns non-zero when the settings should be saved */
+unsigned int process_inputs(ui_state *ui, int64_t now, unsigned int type, joystick_inputs *input,
+                            cfg_settings *settings, uint8_t (*leds)[4], unsigned int *led_explicit_mode,
+                            controller_inputs *output, uint8_t (*packet)[SEND_PACKET_SIZE])
+{
+	unsigned int mode_switch;
+	unsigned int save_settings = 0;
+	int64_t      start;
+	
+	ui->remap_duration = 0;
+	start = stats_time();
+	
+	if (type == 3)
+	{
+		ds3_handle_interaction_and_settings(ui, now, input, output, settings, &(*leds)[2], &mode_switch);
+	}
+	else
+	{
+		save_settings = ds4_handle_interaction_and_settings(ui, now, input, output, settings, leds,
+		                                                    led_explicit_mode, &mode_switch);
+	}
+	
+	stats_record(ui->stats, STATS_HANDLER, stats_time() - start - ui->remap_duration);
+	
+	start = stats_time();
+	serial_construct_packet(output, packet, mode_switch);
+	stats_record(ui->stats, STATS_PACKET_BUILD, stats_time() - start);
+	
+	return save_settings;
+}
+
+/* Replays a recording through the same decoding and frame pipeline as a live controller
+	- Frames are paced as recorded, on the virtual clock when fast is set so the
+	  hold and blink timers see the recorded frame times without waiting for them
+	- Every packet is compared with the checksum recorded for its frame
+	- Settings are the ones recorded in the trace and are never saved */
+int replay(const char *trace_path, int fast)
+{
+	trace           t;
+	trace_record    record;
+	joystick_inputs inputs;
+	cfg_settings    settings;
+	ui_state        ui;
+	stats_set       stats; /* Timed as a live frame is but never registered so never written out */
+	uint8_t         leds[4];
+	unsigned int    led_explicit_mode;
+	unsigned long   frames = 0;
+	unsigned long   events = 0;
+	unsigned long   mismatches = 0;
+	unsigned int    started = 0;
+	int64_t         start;
+	int64_t         due;
+	int64_t         now = 0;
+	int             result;
+	
+	if (trace_open(trace_path, &t) == -1)
+	{
+		fprintf(stderr, "Error opening trace %s\n", trace_path);
+		return -1;
+	}
+	
+	/* Settings and LEDs come from the trace, the host's settings files are never read */
+	memset(&settings, 0, sizeof(settings));
+	memset(&leds, 0, sizeof(leds));
+	
+	joystick_init_inputs(t.type, &inputs);
+	
+	start = clock_real();
+	
+	if (fast)
+	{
+		clock_use_virtual(CLOCK_VIRTUAL_START);
+	}
+	
+	due = clock_now();
+	
+	while ((result = trace_read(&t, &record)) == 1)
+	{
+		if (record.type == TRACE_SETTINGS)
+		{
+			trace_settings captured;
+			
+			if (trace_read_settings(&t, &captured) == -1)
+			{
+				result = -1;
+				break;
+			}
+			
+			settings = captured.settings;
+			init_leds(t.type, &settings, &leds);
+			
+			/* The UI starts at the first frame's captured time so its timers expire on the same frames */
+			if (!started)
+			{
+				now = captured.time;
+				ui_state_init(&ui, now, &stats);
+				started = 1;
+			}
+		}
+		else if (record.type == TRACE_FRAME)
+		{
+			uint8_t           packet[SEND_PACKET_SIZE];
+			controller_inputs output;
+			
+			if (!started)
+			{
+				result = -1;
+				break;
+			}
+			
+			now += (int64_t)record.time * 1000;
+			due += (int64_t)record.time * 1000;
+			clock_sleep_until(due);
+			
+			/* The frame runs at its captured time even when the sleep overshoots */
+			process_inputs(&ui, now, t.type, &inputs, &settings, &leds, &led_explicit_mode, &output, &packet);
+			
+			if (trace_checksum(&packet) != (uint16_t)record.value)
+			{
+				mismatches++;
+			}
+			
+			frames++;
+		}
+		else
+		{
+			joystick_decode_event(t.type, &inputs, &record);
+			
+			events++;
+		}
+	}
+	
+	trace_close(&t);
+	
+	{
+		double elapsed = (double)(clock_real() - start) / 1000000000.0;
+		
+		printf("Replayed DS%u trace: %lu frames, %lu events in %.3fs (%.0f frames per second) | %lu mismatched packets\n",
+		       t.type, frames, events, elapsed, (elapsed > 0) ? (double)frames / elapsed : 0.0, mismatches);
+	}
+	
+	if (result == -1)
+	{
+		fprintf(stderr, "Error reading trace %s\n", trace_path);
+	}
+	
+	return (result == -1 || mismatches) ? -1 : 0;
+}
+
+void apply_controller_map(ui_state *ui, unsigned int mode, controller_inputs *in, controller_inputs *out,
                           controller_map *custom_map, uint8_t default_pressure, uint8_t deadzone)
 {
+	int64_t start = stats_time();
+	
 	if (mode == 1)
 	{
 		unsigned int   i;
@@ -258,78 +854,62 @@ void apply_controller_map(unsigned int mode, controller_inputs *in, controller_i
 	{
 		*out = *in;
 	}
+	
+	ui->remap_duration = stats_time() - start;
+	
+	stats_record(ui->stats, STATS_REMAP, ui->remap_duration);
 }
 
-void ds3_handle_interaction_and_settings(joystick_inputs *in, controller_inputs *out,
+void ds3_handle_interaction_and_settings(ui_state *ui, int64_t now, joystick_inputs *in, controller_inputs *out,
                                          cfg_settings *settings, uint8_t *led, unsigned int *mode_switch)
 {
-	static unsigned int   controller_map_mode = 0; /* 0 == Normal, 1 == Analog->DPAD, 2 == Custom */
-	static int            hold_state = 0;
-	static struct timeval hold_timer = { 0, 0 };
-	static struct timeval blink_timer = { 0, 0 };
+	timer *expired;
 	
 	*mode_switch = 0;
 	
 	if (in->buttons & 0x10000)
 	{
-		if (hold_state == 0)
+		if (ui->hold_state == 0)
 		{
 			*mode_switch = 1;
-			gettimeofday(&hold_timer, NULL);
-			hold_state = 1;
-		}
-		else if (hold_state < 3)
-		{
-			struct timeval now;
-			struct timeval diff;
-			double         elapsed;
-			
-			gettimeofday(&now, NULL);
-			timersub(&now, &hold_timer, &diff);
-			elapsed = diff.tv_sec + diff.tv_usec / 1000000.0;
-			
-			if (hold_state == 1 && elapsed >= (double)(DS3_HOLD_INTERVAL))
-			{
-				controller_map_mode = !controller_map_mode;
-				hold_state = (controller_map_mode != 0) ? 2 : 3;
-			}
-			else if (hold_state == 2 && elapsed >= (double)(DS3_HOLD_INTERVAL * 2))
-			{
-				controller_map_mode = 2;
-				gettimeofday(&blink_timer, NULL);
-				hold_state = 3;
-			}
+			timer_start(&ui->timers, &ui->hold_timer, now + DS3_HOLD_INTERVAL);
+			ui->hold_state = 1;
 		}
 	}
 	else
 	{
-		hold_state = 0;
+		timer_stop(&ui->timers, &ui->hold_timer);
+		ui->hold_state = 0;
 	}
 	
-	if (blink_timer.tv_sec != 0)
+	/* Holding PS toggles Analog->DPAD after one interval and selects Custom after two */
+	while ((expired = timer_wheel_expire(&ui->timers, now)))
 	{
-		struct timeval now;
-		struct timeval diff;
-		double         elapsed;
-		
-		gettimeofday(&now, NULL);
-		timersub(&now, &blink_timer, &diff);
-		elapsed = diff.tv_sec + diff.tv_usec / 1000000.0;
+		if (expired->id != UI_TIMER_HOLD)
+		{
+			continue;
+		}
 		
-		if (elapsed >= (double)(DS3_BLINK_INTERVAL))
+		if (ui->hold_state == 1)
 		{
-			blink_timer.tv_sec = 0;
+			ui->controller_map_mode = !ui->controller_map_mode;
+			ui->hold_state = (ui->controller_map_mode != 0) ? 2 : 3;
+			
+			if (ui->hold_state == 2)
+			{
+				timer_start(&ui->timers, &ui->hold_timer, expired->expires + DS3_HOLD_INTERVAL);
+			}
 		}
-		else
+		else if (ui->hold_state == 2)
 		{
-			*led = 0;
+			ui->controller_map_mode = 2;
+			timer_start(&ui->timers, &ui->blink_timer, now + DS3_BLINK_INTERVAL);
+			ui->hold_state = 3;
 		}
 	}
 	
-	if (blink_timer.tv_sec == 0)
-	{
-		*led = !!controller_map_mode;
-	}
+	/* The LED is off while blinking */
+	*led = ui->blink_timer.armed ? 0 : !!ui->controller_map_mode;
 	
 	{
 		unsigned int      i;
@@ -347,7 +927,7 @@ void ds3_handle_interaction_and_settings(joystick_inputs *in, controller_inputs
 			}
 		}
 		
-		apply_controller_map(controller_map_mode, &tmp, out, &settings->map,
+		apply_controller_map(ui, ui->controller_map_mode, &tmp, out, &settings->map,
 		                     settings->default_pressure, settings->analog_to_button_deadzone);
 	}
 }
@@ -381,110 +961,104 @@ void ds4_range_adjust(int16_t *x_inout, int16_t *y_inout, double divisor)
 	*y_inout = (int16_t)(y);
 }
 
-unsigned int ds4_handle_interaction_and_settings(joystick_inputs *in, controller_inputs *out,
-                                                 cfg_settings *settings, uint8_t (*leds)[4],
-                                                 unsigned int *led_explicit_mode, unsigned int *mode_switch)
+unsigned int ds4_handle_interaction_and_settings(ui_state *ui, int64_t now, joystick_inputs *in,
+                                                 controller_inputs *out, cfg_settings *settings,
+                                                 uint8_t (*leds)[4], unsigned int *led_explicit_mode,
+                                                 unsigned int *mode_switch)
 {
-	static unsigned int    initialized = 0;
-	static unsigned int    controller_map_mode = 0; /* 0 == Normal, 1 == Analog->DPAD, 2 == Custom */
-	static unsigned int    blink_state = 0;
-	static struct timeval  blink_timer = { 0, 0 };
-	static joystick_inputs previous;
-	static unsigned int    color_set_mode = 0;
-	static uint8_t         saved_leds[3];
-	static uint8_t         emulated_pressure;
-	static unsigned int    analog_emulated_range;
-	unsigned int           save_settings;
+	unsigned int save_settings;
+	unsigned int blink_started = 0;
+	timer       *expired;
 	
-	if (!initialized)
+	if (!ui->initialized)
 	{
-		emulated_pressure = settings->default_pressure;
-		analog_emulated_range = settings->ds4_range_emulation_default;
-		previous = *in;
-		initialized = 1;
+		ui->emulated_pressure = settings->default_pressure;
+		ui->analog_emulated_range = settings->ds4_range_emulation_default;
+		ui->previous = *in;
+		ui->initialized = 1;
 	}
 	
 	save_settings = 0;
 	
 	if (in->buttons & 0x20000)
 	{
-		if ((in->axes.named.l1 != 0 && previous.axes.named.l1 == 0)
-		||  (in->axes.named.r1 != 0 && previous.axes.named.r1 == 0))
+		if ((in->axes.named.l1 != 0 && ui->previous.axes.named.l1 == 0)
+		||  (in->axes.named.r1 != 0 && ui->previous.axes.named.r1 == 0))
 		{
-			if (!color_set_mode)
+			if (!ui->color_set_mode)
 			{
-				saved_leds[0] = (*leds)[0];
-				saved_leds[1] = (*leds)[1];
-				saved_leds[2] = (*leds)[2];
-				color_set_mode = 1;
-				blink_state = 1;
-				gettimeofday(&blink_timer, NULL);
+				ui->saved_leds[0] = (*leds)[0];
+				ui->saved_leds[1] = (*leds)[1];
+				ui->saved_leds[2] = (*leds)[2];
+				ui->color_set_mode = 1;
+				ui->blink_state = 1;
+				blink_started = 1;
 			}
 			else
 			{
 				settings->ds4_leds[DS4_LED_RED] = (*leds)[0];
 				settings->ds4_leds[DS4_LED_GREEN] = (*leds)[1];
 				settings->ds4_leds[DS4_LED_BLUE] = (*leds)[2];
-				color_set_mode = 0;
+				ui->color_set_mode = 0;
 				save_settings = 1;
-				blink_state = 3;
-				gettimeofday(&blink_timer, NULL);
+				ui->blink_state = 3;
+				blink_started = 1;
 			}
 		}
-		else if ((in->buttons & 0x1) && !(previous.buttons & 0x1)) /* Select */
+		else if ((in->buttons & 0x1) && !(ui->previous.buttons & 0x1)) /* Select */
 		{
-			analog_emulated_range = 0;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->analog_emulated_range = 0;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if ((in->buttons & 0x8) && !(previous.buttons & 0x8)) /* Start */
+		else if ((in->buttons & 0x8) && !(ui->previous.buttons & 0x8)) /* Start */
 		{
-			analog_emulated_range = 1;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->analog_emulated_range = 1;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if ((in->axes.named.up != 0 && previous.axes.named.up == 0)
-			  || (in->axes.named.down != 0 && previous.axes.named.down == 0))
+		else if ((in->axes.named.up != 0 && ui->previous.axes.named.up == 0)
+			  || (in->axes.named.down != 0 && ui->previous.axes.named.down == 0))
 		{
-			controller_map_mode = 0;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->controller_map_mode = 0;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.left != 0 && previous.axes.named.left == 0)
+		else if (in->axes.named.left != 0 && ui->previous.axes.named.left == 0)
 		{
-			controller_map_mode = 1;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->controller_map_mode = 1;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.right != 0 && previous.axes.named.right == 0)
+		else if (in->axes.named.right != 0 && ui->previous.axes.named.right == 0)
 		{
-			controller_map_mode = 2;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->controller_map_mode = 2;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.triangle != 0 && previous.axes.named.triangle == 0)
+		else if (in->axes.named.triangle != 0 && ui->previous.axes.named.triangle == 0)
 		{
-			emulated_pressure = settings->ds4_triangle_pressure;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->emulated_pressure = settings->ds4_triangle_pressure;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.circle != 0 && previous.axes.named.circle == 0)
+		else if (in->axes.named.circle != 0 && ui->previous.axes.named.circle == 0)
 		{
-			emulated_pressure = settings->ds4_circle_pressure;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->emulated_pressure = settings->ds4_circle_pressure;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.cross != 0 && previous.axes.named.cross == 0)
+		else if (in->axes.named.cross != 0 && ui->previous.axes.named.cross == 0)
 		{
-			emulated_pressure = settings->ds4_cross_pressure;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->emulated_pressure = settings->ds4_cross_pressure;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
-		else if (in->axes.named.square != 0 && previous.axes.named.square == 0)
+		else if (in->axes.named.square != 0 && ui->previous.axes.named.square == 0)
 		{
-			emulated_pressure = settings->ds4_square_pressure;
-			blink_state = 1;
-			gettimeofday(&blink_timer, NULL);
+			ui->emulated_pressure = settings->ds4_square_pressure;
+			ui->blink_state = 1;
+			blink_started = 1;
 		}
 	}
 	else
@@ -493,21 +1067,21 @@ unsigned int ds4_handle_interaction_and_settings(joystick_inputs *in, controller
 		int16_t           sticks[4];
 		controller_inputs tmp;
 		
-		if (color_set_mode)
+		if (ui->color_set_mode)
 		{
-			(*leds)[0] = saved_leds[0];
-			(*leds)[1] = saved_leds[1];
-			(*leds)[2] = saved_leds[2];
+			(*leds)[0] = ui->saved_leds[0];
+			(*leds)[1] = ui->saved_leds[1];
+			(*leds)[2] = ui->saved_leds[2];
 		}
 		
-		color_set_mode = 0;
+		ui->color_set_mode = 0;
 		
 		sticks[0] = in->axes.buffer[0];
 		sticks[1] = in->axes.buffer[1];
 		sticks[2] = in->axes.buffer[2];
 		sticks[3] = in->axes.buffer[3];
 		
-		if (analog_emulated_range)
+		if (ui->analog_emulated_range)
 		{
 			ds4_range_adjust(&sticks[0], &sticks[1], settings->ds4_range_emulation_divisor);
 			ds4_range_adjust(&sticks[2], &sticks[3], settings->ds4_range_emulation_divisor);
@@ -532,50 +1106,59 @@ unsigned int ds4_handle_interaction_and_settings(joystick_inputs *in, controller
 			}
 			else
 			{
-				tmp.axes.buffer[i] = (uint8_t)in->axes.buffer[i] * emulated_pressure;
+				tmp.axes.buffer[i] = (uint8_t)in->axes.buffer[i] * ui->emulated_pressure;
 			}
 		}
 		
-		apply_controller_map(controller_map_mode, &tmp, out, &settings->map,
-		                     emulated_pressure, settings->analog_to_button_deadzone);
+		apply_controller_map(ui, ui->controller_map_mode, &tmp, out, &settings->map,
+		                     ui->emulated_pressure, settings->analog_to_button_deadzone);
 	}
 	
-	if (blink_state > 0)
+	if (blink_started)
 	{
-		struct timeval now;
-		struct timeval diff;
-		double         elapsed;
-		unsigned int   periods;
-		
-		gettimeofday(&now, NULL);
-		timersub(&now, &blink_timer, &diff);
-		elapsed = diff.tv_sec + diff.tv_usec / 1000000.0;
-		periods = (unsigned int)(elapsed / (double)(DS4_BLINK_INTERVAL));
-		
-		(*leds)[3] = (uint8_t)(periods & 1);
+		ui->blink_periods = 0;
+		timer_start(&ui->timers, &ui->blink_timer, now + DS4_BLINK_INTERVAL);
+	}
+	
+	/* The LED toggles every period and the colors are restored after ui->blink_state periods */
+	while ((expired = timer_wheel_expire(&ui->timers, now)))
+	{
+		if (expired->id != UI_TIMER_BLINK || ui->blink_state == 0)
+		{
+			continue;
+		}
 		
-		if (periods >= blink_state)
+		if (++ui->blink_periods >= ui->blink_state)
 		{
 			(*leds)[0] = settings->ds4_leds[DS4_LED_RED];
 			(*leds)[1] = settings->ds4_leds[DS4_LED_GREEN];
 			(*leds)[2] = settings->ds4_leds[DS4_LED_BLUE];
 			(*leds)[3] = 1;
 			
-			blink_state = 0;
+			ui->blink_state = 0;
+		}
+		else
+		{
+			timer_start(&ui->timers, &ui->blink_timer, expired->expires + DS4_BLINK_INTERVAL);
 		}
 	}
 	
-	if (blink_state == 0 && color_set_mode)
+	if (ui->blink_state > 0)
+	{
+		(*leds)[3] = (uint8_t)(ui->blink_periods & 1);
+	}
+	
+	if (ui->blink_state == 0 && ui->color_set_mode)
 	{
 		(*leds)[0] = (uint8_t)((((int32_t)in->axes.named.l2) + 32768) / 1024);
 		(*leds)[1] = (uint8_t)((((int32_t)in->axes.named.r2) + 32768) / 1024);
 		(*leds)[2] = (uint8_t)((((int32_t)-in->axes.named.ly) + 32768) / 1024);
 	}
 	
-	*led_explicit_mode = blink_state != 0 || color_set_mode;
-	*mode_switch = ((in->buttons & 0x10000) && !(previous.buttons & 0x10000));
+	*led_explicit_mode = ui->blink_state != 0 || ui->color_set_mode;
+	*mode_switch = ((in->buttons & 0x10000) && !(ui->previous.buttons & 0x10000));
 	
-	previous = *in;
+	ui->previous = *in;
 	
 	return save_settings;
 }
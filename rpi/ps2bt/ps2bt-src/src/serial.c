@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <termios.h>
 #include "serial.h"
 
@@ -77,7 +78,7 @@ int serial_init(const char *serial_path)
 
 void serial_construct_packet(controller_inputs *inputs, uint8_t (*packet)[SEND_PACKET_SIZE], int mode_switch)
 {
-	(*packet)[0] = 0x5A;
+	(*packet)[0] = SERIAL_HEADER;
 	
 	(*packet)[1] = ~((uint8_t *)&inputs->buttons)[0];
 	(*packet)[2] = ~((uint8_t *)&inputs->buttons)[1];
@@ -112,8 +113,10 @@ void serial_construct_packet(controller_inputs *inputs, uint8_t (*packet)[SEND_P
 	}
 }
 
-int serial_send_packet(int fd, uint8_t (*packet)[SEND_PACKET_SIZE])
+int serial_send_packet(int fd, unsigned int slot, uint8_t (*packet)[SEND_PACKET_SIZE])
 {
+	(*packet)[0] = (uint8_t)(SERIAL_HEADER + slot);
+	
 	if (write(fd, (void *)packet, SEND_PACKET_SIZE) == -1)
 	{
 		return -1;
@@ -122,24 +125,129 @@ int serial_send_packet(int fd, uint8_t (*packet)[SEND_PACKET_SIZE])
 	return 0;
 }
 
-int serial_send_disconnect_packet(int fd)
+int serial_send_disconnect_packet(int fd, unsigned int slot)
 {
 	uint8_t packet[SEND_PACKET_SIZE];
 	
 	memset(&packet[0], 0, sizeof(packet));
 	
-	packet[0] = 0x5A;
 	packet[19] = 0x5A;
 	
-	return serial_send_packet(fd, &packet);
+	return serial_send_packet(fd, slot, &packet);
 }
 
-int serial_recv_packet(int fd, uint8_t (*packet)[RECV_PACKET_SIZE])
+int serial_send_diagnostics_packet(int fd, unsigned int slot)
 {
-	if (read(fd, (void *)packet, RECV_PACKET_SIZE) != RECV_PACKET_SIZE)
+	uint8_t packet[SEND_PACKET_SIZE];
+	
+	memset(&packet[0], 0, sizeof(packet));
+	
+	packet[19] = SERIAL_DIAGNOSTICS_FOOTER;
+	
+	return serial_send_packet(fd, slot, &packet);
+}
+
+static int serial_read_packet(int fd, uint8_t (*packet)[RECV_PACKET_SIZE])
+{
+	unsigned int received = 0;
+	
+	/* A packet may be split across USB transfers so keep reading until it is complete */
+	while (received < RECV_PACKET_SIZE)
 	{
-		return -1;
+		ssize_t result;
+		
+		result = read(fd, (void *)&(*packet)[received], RECV_PACKET_SIZE - received);
+		
+		if (result <= 0)
+		{
+			return -1;
+		}
+		
+		received += (unsigned int)result;
 	}
 	
 	return 0;
 }
+
+/*  - Replies which arrived late are queued ahead of the newest one so they are drained
+	  and only the newest is kept
+	- Replies for the other slots of a shared Teensy can only be late ones, their pipelines
+	  have stopped waiting, so they are dropped */
+int serial_recv_packet(int fd, unsigned int slot, uint8_t (*packet)[RECV_PACKET_SIZE], int timeout_ms)
+{
+	uint8_t       reply[RECV_PACKET_SIZE];
+	struct pollfd pfd;
+	int           received = 0;
+	
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	
+	while (1)
+	{
+		int result;
+		
+		result = poll(&pfd, 1, received ? 0 : timeout_ms);
+		
+		if (result == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		if (result == 0)
+		{
+			return received;
+		}
+		
+		if (serial_read_packet(fd, &reply) == -1)
+		{
+			return -1;
+		}
+		
+		if (reply[0] == SERIAL_HEADER + slot)
+		{
+			memcpy(*packet, reply, RECV_PACKET_SIZE);
+			received = 1;
+		}
+	}
+}
+
+int serial_discard_replies(int fd)
+{
+	uint8_t       reply[RECV_PACKET_SIZE];
+	struct pollfd pfd;
+	
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	
+	while (1)
+	{
+		int result;
+		
+		result = poll(&pfd, 1, 0);
+		
+		if (result == -1)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			
+			return -1;
+		}
+		
+		if (result == 0)
+		{
+			return 0;
+		}
+		
+		if (serial_read_packet(fd, &reply) == -1)
+		{
+			return -1;
+		}
+	}
+}
@@ -0,0 +1,275 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* nanosleep() */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "clock.h"
+#include "stats.h"
+
+static stats_set      *stats_sets;  /* Registered sets - the mutex guards the list, not the histograms */
+static const char     *stats_path;
+static pthread_t       stats_thread;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile unsigned int stats_sync_locked;
+static volatile int64_t      stats_sync_period;
+static volatile int64_t      stats_sync_error;
+
+static const char *stats_names[STATS_STAGES] =
+{
+	"event_read",
+	"decode",
+	"publish",
+	"handler",
+	"remap",
+	"packet_build",
+	"serial_write",
+	"reply_read",
+	"output",
+	"frame"
+};
+
+static unsigned int stats_bucket(int64_t value)
+{
+	unsigned int shift = 0;
+	
+	if (value < 2 * STATS_SUB_BUCKETS)
+	{
+		return (value < 0) ? 0 : (unsigned int)value;
+	}
+	
+	if (value >= STATS_LIMIT)
+	{
+		return STATS_BUCKETS - 1;
+	}
+	
+	/* Shift until the value is in [STATS_SUB_BUCKETS, 2 * STATS_SUB_BUCKETS) */
+	while ((value >> shift) >= 2 * STATS_SUB_BUCKETS)
+	{
+		shift++;
+	}
+	
+	return shift * STATS_SUB_BUCKETS + (unsigned int)(value >> shift);
+}
+
+/* Lowest value of a bucket */
+static int64_t stats_bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+	
+	if (bucket < 2 * STATS_SUB_BUCKETS)
+	{
+		return bucket;
+	}
+	
+	shift = bucket / STATS_SUB_BUCKETS - 1;
+	
+	return (int64_t)(bucket - shift * STATS_SUB_BUCKETS) << shift;
+}
+
+static int64_t stats_percentile(stats_histogram *h, uint64_t count, double percentile)
+{
+	uint64_t     rank = (uint64_t)((double)count * percentile);
+	uint64_t     seen = 0;
+	unsigned int i;
+	
+	for (i = 0; i < STATS_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		
+		/* Buckets are reported by their lowest value but never outside the recorded range */
+		if (seen > rank)
+		{
+			int64_t value = stats_bucket_value(i);
+			
+			return (value < h->min) ? h->min : ((value > h->max) ? h->max : value);
+		}
+	}
+	
+	return h->max;
+}
+
+void stats_sync(unsigned int locked, int64_t period, int64_t error)
+{
+	stats_sync_locked = locked;
+	stats_sync_period = period;
+	stats_sync_error = error;
+}
+
+int64_t stats_time(void)
+{
+	return clock_real();
+}
+
+void stats_register(stats_set *set)
+{
+	memset(set, 0, sizeof(stats_set));
+	
+	pthread_mutex_lock(&stats_mutex);
+	
+	set->next = stats_sets;
+	stats_sets = set;
+	
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_record(stats_set *set, unsigned int stage, int64_t duration)
+{
+	stats_histogram *h = &set->stages[stage];
+	
+	if (!h->count || duration < h->min)
+	{
+		h->min = duration;
+	}
+	
+	if (duration > h->max)
+	{
+		h->max = duration;
+	}
+	
+	h->counts[stats_bucket(duration)]++;
+	h->total += (uint64_t)duration;
+	h->count++;
+}
+
+/* Sums the histograms of stage in every registered set into merged */
+static void stats_merge(unsigned int stage, stats_histogram *merged)
+{
+	stats_set   *set;
+	unsigned int i;
+	
+	memset(merged, 0, sizeof(stats_histogram));
+	
+	pthread_mutex_lock(&stats_mutex);
+	
+	for (set = stats_sets; set; set = set->next)
+	{
+		stats_histogram h = set->stages[stage];
+		
+		if (!h.count)
+		{
+			continue;
+		}
+		
+		if (!merged->count || h.min < merged->min)
+		{
+			merged->min = h.min;
+		}
+		
+		if (h.max > merged->max)
+		{
+			merged->max = h.max;
+		}
+		
+		for (i = 0; i < STATS_BUCKETS; i++)
+		{
+			merged->counts[i] += h.counts[i];
+		}
+		
+		merged->total += h.total;
+		merged->count += h.count;
+	}
+	
+	pthread_mutex_unlock(&stats_mutex);
+}
+
+/* One line per stage in microseconds since ps2bt started - a temporary file is renamed
+   over path so readers never see a partial file */
+static int stats_write(const char *path)
+{
+	static stats_histogram h; /* Merged from every set - only this thread writes the file */
+	char                   temp_path[256];
+	FILE                  *file;
+	unsigned int           i;
+	
+	if (strlen(path) + 5 > sizeof(temp_path))
+	{
+		return -1;
+	}
+	
+	sprintf(temp_path, "%s.tmp", path);
+	
+	if (!(file = fopen(temp_path, "w")))
+	{
+		return -1;
+	}
+	
+	fprintf(file, "%-12s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+	        "stage", "count", "min_us", "p50_us", "p90_us", "p99_us", "p999_us", "max_us", "mean_us");
+	
+	for (i = 0; i < STATS_STAGES; i++)
+	{
+		stats_merge(i, &h);
+		
+		if (!h.count)
+		{
+			fprintf(file, "%-12s %10lu\n", stats_names[i], 0UL);
+			continue;
+		}
+		
+		fprintf(file, "%-12s %10lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		        stats_names[i], (unsigned long)h.count,
+		        (double)h.min / 1000.0,
+		        (double)stats_percentile(&h, h.count, 0.50) / 1000.0,
+		        (double)stats_percentile(&h, h.count, 0.90) / 1000.0,
+		        (double)stats_percentile(&h, h.count, 0.99) / 1000.0,
+		        (double)stats_percentile(&h, h.count, 0.999) / 1000.0,
+		        (double)h.max / 1000.0,
+		        (double)h.total / (double)h.count / 1000.0);
+	}
+	
+	fprintf(file, "sync %s period_us %.1f error_us %.1f\n", stats_sync_locked ? "locked" : "unlocked",
+	        (double)stats_sync_period / 1000.0, (double)stats_sync_error / 1000.0);
+	
+	if (fclose(file) != 0 || rename(temp_path, path) == -1)
+	{
+		remove(temp_path);
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Real time is used here as the file is only for people and monitors */
+static void *stats_writer_thread(void *data)
+{
+	struct timespec interval;
+	
+	(void)data;
+	
+	interval.tv_sec = (time_t)(STATS_INTERVAL / 1000000000);
+	interval.tv_nsec = (long)(STATS_INTERVAL % 1000000000);
+	
+	while (1)
+	{
+		nanosleep(&interval, NULL);
+		
+		stats_write(stats_path);
+	}
+	
+	return NULL;
+}
+
+int stats_start(const char *path)
+{
+	stats_path = path;
+	
+	return (pthread_create(&stats_thread, NULL, &stats_writer_thread, NULL) != 0) ? -1 : 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "timer.h"
+
+void timer_wheel_init(timer_wheel *wheel, int64_t now)
+{
+	memset(wheel, 0, sizeof(timer_wheel));
+	
+	wheel->tick = now / TIMER_WHEEL_TICK;
+}
+
+void timer_init(timer *t, unsigned int id)
+{
+	memset(t, 0, sizeof(timer));
+	
+	t->id = id;
+}
+
+/* A timer which is already due goes in the next slot to be examined */
+void timer_start(timer_wheel *wheel, timer *t, int64_t expires)
+{
+	int64_t tick;
+	
+	timer_stop(wheel, t);
+	
+	tick = expires / TIMER_WHEEL_TICK;
+	tick = (tick < wheel->tick) ? wheel->tick : tick;
+	
+	t->expires = expires;
+	t->armed = 1;
+	t->slot = (unsigned int)(tick % TIMER_WHEEL_SLOTS);
+	t->next = wheel->slots[t->slot];
+	wheel->slots[t->slot] = t;
+}
+
+void timer_stop(timer_wheel *wheel, timer *t)
+{
+	timer **link;
+	
+	if (!t->armed)
+	{
+		return;
+	}
+	
+	for (link = &wheel->slots[t->slot]; *link != t; link = &(*link)->next) continue;
+	
+	*link = t->next;
+	
+	t->armed = 0;
+	t->next = NULL;
+}
+
+timer *timer_wheel_expire(timer_wheel *wheel, int64_t now)
+{
+	int64_t last = now / TIMER_WHEEL_TICK;
+	
+	/* One revolution covers every slot however far time has jumped */
+	if (last - wheel->tick >= TIMER_WHEEL_SLOTS)
+	{
+		wheel->tick = last - (TIMER_WHEEL_SLOTS - 1);
+	}
+	
+	while (1)
+	{
+		timer **link;
+		
+		for (link = &wheel->slots[wheel->tick % TIMER_WHEEL_SLOTS]; *link; link = &(*link)->next)
+		{
+			if ((*link)->expires <= now)
+			{
+				timer *t = *link;
+				
+				*link = t->next;
+				t->armed = 0;
+				t->next = NULL;
+				
+				return t;
+			}
+		}
+		
+		/* The current tick's slot is examined again until its tick has fully passed */
+		if (wheel->tick >= last)
+		{
+			return NULL;
+		}
+		
+		wheel->tick++;
+	}
+}
@@ -0,0 +1,152 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "trace.h"
+
+#define TRACE_HEADER_SIZE 12
+
+int trace_create(const char *path, unsigned int type, trace *t)
+{
+	uint8_t header[TRACE_HEADER_SIZE];
+	
+	memset(t, 0, sizeof(trace));
+	memset(header, 0, sizeof(header));
+	
+	if (!(t->file = fopen(path, "wb")))
+	{
+		return -1;
+	}
+	
+	memcpy(header, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	header[8] = TRACE_VERSION;
+	header[9] = (uint8_t)type;
+	
+	if (fwrite(header, sizeof(header), 1, t->file) != 1)
+	{
+		fclose(t->file);
+		return -1;
+	}
+	
+	t->type = type;
+	
+	return 0;
+}
+
+int trace_open(const char *path, trace *t)
+{
+	uint8_t header[TRACE_HEADER_SIZE];
+	
+	memset(t, 0, sizeof(trace));
+	
+	if (!(t->file = fopen(path, "rb")))
+	{
+		return -1;
+	}
+	
+	if (fread(header, sizeof(header), 1, t->file) != 1
+	||  memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0
+	||  header[8] != TRACE_VERSION
+	|| (header[9] != 3 && header[9] != 4))
+	{
+		fclose(t->file);
+		return -1;
+	}
+	
+	t->type = header[9];
+	
+	return 0;
+}
+
+void trace_close(trace *t)
+{
+	if (t->file)
+	{
+		fclose(t->file);
+		t->file = NULL;
+	}
+}
+
+/* Events are written while the joystick thread publishes them so they are
+   ordered exactly as the frames observed them */
+void trace_write_events(trace *t, const struct js_event *events, unsigned int count)
+{
+	fwrite(events, sizeof(struct js_event), count, t->file);
+}
+
+void trace_write_frame(trace *t, int64_t now, uint8_t (*packet)[SEND_PACKET_SIZE])
+{
+	trace_record record;
+	
+	record.time = t->last_frame ? (uint32_t)((now - t->last_frame) / 1000) : 0;
+	record.value = (int16_t)trace_checksum(packet);
+	record.type = TRACE_FRAME;
+	record.number = 0;
+	
+	/* Advanced by the recorded delta rather than set to now so truncating to whole microseconds
+	   never accumulates and a replay adding up the deltas stays on the captured frame times */
+	t->last_frame = t->last_frame ? t->last_frame + (int64_t)record.time * 1000 : now;
+	
+	fwrite(&record, sizeof(record), 1, t->file);
+}
+
+void trace_write_settings(trace *t, int64_t now, const cfg_settings *settings)
+{
+	trace_record   record;
+	trace_settings captured;
+	
+	memset(&record, 0, sizeof(record));
+	memset(&captured, 0, sizeof(captured));
+	
+	record.type = TRACE_SETTINGS;
+	
+	captured.time = now;
+	memcpy(&captured.settings, settings, sizeof(cfg_settings));
+	
+	fwrite(&record, sizeof(record), 1, t->file);
+	fwrite(&captured, sizeof(captured), 1, t->file);
+}
+
+int trace_read(trace *t, trace_record *record)
+{
+	if (fread(record, sizeof(trace_record), 1, t->file) == 1)
+	{
+		return 1;
+	}
+	
+	return ferror(t->file) ? -1 : 0;
+}
+
+int trace_read_settings(trace *t, trace_settings *settings)
+{
+	return (fread(settings, sizeof(trace_settings), 1, t->file) == 1) ? 0 : -1;
+}
+
+/* Fletcher-16 */
+uint16_t trace_checksum(uint8_t (*packet)[SEND_PACKET_SIZE])
+{
+	unsigned int i;
+	uint16_t     a = 0;
+	uint16_t     b = 0;
+	
+	for (i = 0; i < SEND_PACKET_SIZE; i++)
+	{
+		a = (a + (*packet)[i]) % 255;
+		b = (b + a) % 255;
+	}
+	
+	return (uint16_t)((b << 8) | a);
+}
@@ -0,0 +1,179 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/inotify.h>
+#include "watch.h"
+
+#define CFG_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+
+/* Swaps the pending pointer with a full barrier so the settings it points to are
+   complete before another thread can see the pointer */
+static cfg_settings *cfg_watch_exchange(cfg_watch *watch, cfg_settings *settings)
+{
+	__sync_synchronize();
+	
+	return __sync_lock_test_and_set(&watch->pending, settings);
+}
+
+/* Adds a watch on the directory holding path
+	- Returns the watch descriptor or -1 on error */
+static int cfg_watch_add(int inotify, const char *path)
+{
+	char        directory[256];
+	const char *slash = strrchr(path, '/');
+	
+	if (!slash)
+	{
+		strcpy(directory, ".");
+	}
+	else if (slash == path)
+	{
+		strcpy(directory, "/");
+	}
+	else if ((size_t)(slash - path) < sizeof(directory))
+	{
+		memcpy(directory, path, slash - path);
+		directory[slash - path] = '\0';
+	}
+	else
+	{
+		return -1;
+	}
+	
+	return inotify_add_watch(inotify, directory, CFG_WATCH_EVENTS);
+}
+
+static const char *cfg_watch_name(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	
+	return slash ? slash + 1 : path;
+}
+
+/* Returns non-zero when the buffer holds an event for either settings file */
+static int cfg_watch_relevant(cfg_watch *watch, char *buffer, ssize_t size)
+{
+	ssize_t offset = 0;
+	int     relevant = 0;
+	
+	while (offset + (ssize_t)sizeof(struct inotify_event) <= size)
+	{
+		struct inotify_event *event = (struct inotify_event *)&buffer[offset];
+		
+		if (event->len
+		&& (!strcmp(event->name, cfg_watch_name(watch->profiles->ro_path))
+		||  !strcmp(event->name, cfg_watch_name(watch->profiles->rw_path))))
+		{
+			relevant = 1;
+		}
+		
+		offset += sizeof(struct inotify_event) + event->len;
+	}
+	
+	return relevant;
+}
+
+static void *cfg_watch_thread(void *data)
+{
+	cfg_watch *watch = (cfg_watch *)data;
+	char       buffer[4096];
+	ssize_t    size;
+	
+	while ((size = read(watch->inotify, buffer, sizeof(buffer))) > 0)
+	{
+		cfg_settings *settings;
+		
+		if (!cfg_watch_relevant(watch, buffer, size))
+		{
+			continue;
+		}
+		
+		/* Editors and cp write in several steps so wait for the files to settle */
+		while (1)
+		{
+			fd_set         set;
+			struct timeval timeout;
+			
+			FD_ZERO(&set);
+			FD_SET(watch->inotify, &set);
+			
+			timeout.tv_sec = 0;
+			timeout.tv_usec = CFG_WATCH_SETTLE_MS * 1000;
+			
+			if (select(watch->inotify + 1, &set, NULL, NULL, &timeout) <= 0
+			|| (size = read(watch->inotify, buffer, sizeof(buffer))) <= 0)
+			{
+				break;
+			}
+		}
+		
+		if (!(settings = malloc(sizeof(cfg_settings))))
+		{
+			continue;
+		}
+		
+		cfg_profile_load(watch->profiles, watch->address, settings);
+		
+		free(cfg_watch_exchange(watch, settings));
+	}
+	
+	return NULL;
+}
+
+int cfg_watch_start(cfg_profile_store *profiles, const uint8_t *address, cfg_watch *watch)
+{
+	int ro_watch;
+	int rw_watch;
+	
+	memset(watch, 0, sizeof(cfg_watch));
+	
+	watch->profiles = profiles;
+	watch->address = address;
+	
+	if ((watch->inotify = inotify_init()) == -1)
+	{
+		return -1;
+	}
+	
+	/* One directory may not exist yet (the RW file lives on a loop mount) so one watch is enough */
+	ro_watch = cfg_watch_add(watch->inotify, profiles->ro_path);
+	rw_watch = cfg_watch_add(watch->inotify, profiles->rw_path);
+	
+	if ((ro_watch == -1 && rw_watch == -1)
+	||  pthread_create(&watch->thread, NULL, &cfg_watch_thread, (void *)watch) != 0)
+	{
+		close(watch->inotify);
+		return -1;
+	}
+	
+	return 0;
+}
+
+cfg_settings *cfg_watch_take(cfg_watch *watch)
+{
+	/* A plain read first keeps the common case free of locked instructions */
+	if (!watch->pending)
+	{
+		return NULL;
+	}
+	
+	return cfg_watch_exchange(watch, NULL);
+}
@@ -0,0 +1,130 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define _POSIX_C_SOURCE 200112L /* pthread_condattr_setclock() */
+
+#include <string.h>
+#include <time.h>
+#include "writer.h"
+
+static void *cfg_writer_thread(void *data)
+{
+	cfg_writer *writer = (cfg_writer *)data;
+	
+	pthread_mutex_lock(&writer->mutex);
+	
+	while (1)
+	{
+		cfg_settings settings;
+		
+		while (!writer->pending && !writer->stop)
+		{
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		}
+		
+		if (!writer->pending)
+		{
+			break;
+		}
+		
+		/* Wait out a burst of requests - each one restarts the wait */
+		while (!writer->stop)
+		{
+			unsigned int    generation = writer->generation;
+			struct timespec deadline;
+			
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			
+			deadline.tv_sec += CFG_WRITER_SETTLE_MS / 1000;
+			deadline.tv_nsec += (CFG_WRITER_SETTLE_MS % 1000) * 1000000L;
+			
+			if (deadline.tv_nsec >= 1000000000L)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			
+			while (generation == writer->generation && !writer->stop
+			&&     pthread_cond_timedwait(&writer->cond, &writer->mutex, &deadline) == 0) continue;
+			
+			if (generation == writer->generation)
+			{
+				break;
+			}
+		}
+		
+		settings = writer->settings;
+		writer->pending = 0;
+		
+		/* The file is written without the mutex so requests never wait for it */
+		pthread_mutex_unlock(&writer->mutex);
+		cfg_profile_save(writer->profiles, writer->address, &settings);
+		pthread_mutex_lock(&writer->mutex);
+	}
+	
+	pthread_mutex_unlock(&writer->mutex);
+	
+	return NULL;
+}
+
+int cfg_writer_start(cfg_profile_store *profiles, const uint8_t *address, cfg_writer *writer)
+{
+	pthread_condattr_t attr;
+	
+	memset(writer, 0, sizeof(cfg_writer));
+	
+	writer->profiles = profiles;
+	writer->address = address;
+	
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	
+	pthread_mutex_init(&writer->mutex, NULL);
+	pthread_cond_init(&writer->cond, &attr);
+	
+	pthread_condattr_destroy(&attr);
+	
+	if (pthread_create(&writer->thread, NULL, &cfg_writer_thread, (void *)writer) != 0)
+	{
+		return -1;
+	}
+	
+	return 0;
+}
+
+void cfg_writer_request(cfg_writer *writer, const cfg_settings *settings)
+{
+	pthread_mutex_lock(&writer->mutex);
+	
+	writer->settings = *settings;
+	writer->pending = 1;
+	writer->generation++;
+	
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+}
+
+void cfg_writer_stop(cfg_writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+	
+	writer->stop = 1;
+	
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->mutex);
+	
+	pthread_join(writer->thread, NULL);
+}
@@ -0,0 +1,476 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Settings file validator
+	- Usage: ps2bt-cfgc [-d] <settings file>
+	- Reports values outside the ranges documented in settings.cfg, unknown sections and keys,
+	  mappings to unknown controls and keys defined more than once, with their line numbers
+	- [custom_mapping.<address>] sections of single controllers are checked like [custom_mapping]
+	- -d prints the remap program the custom mapping compiles to
+	- Exits with 1 when any error was reported */
+
+#define _POSIX_C_SOURCE 200112L /* getopt() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ini.h"
+#include "cfg.h"
+#include "controller.h"
+
+typedef enum
+{
+	CFGC_INTEGER,
+	CFGC_DECIMAL,
+	CFGC_BOOLEAN, /* true | false */
+	CFGC_SWITCH,  /* on | off */
+	CFGC_CONTROL  /* Control name or empty */
+} cfgc_type;
+
+typedef struct
+{
+	const char *section;
+	const char *key;
+	cfgc_type   type;
+	double      min;
+	double      max;
+} cfgc_rule;
+
+/* Every key cfg_file_read() looks up with the ranges it clamps to - custom_mapping keys are the control names */
+static const cfgc_rule cfgc_rules[] =
+{
+	{ "common", "default_pressure",               CFGC_INTEGER, 1,   255   },
+	{ "common", "analog_to_button_deadzone",      CFGC_INTEGER, 0,   126   },
+	{ "common", "frame_sync",                     CFGC_BOOLEAN, 0,   0     },
+	{ "common", "frame_sync_guard",               CFGC_INTEGER, 100, 10000 },
+	{ "ds3",    "led_one",                        CFGC_SWITCH,  0,   0     },
+	{ "ds3",    "led_two",                        CFGC_SWITCH,  0,   0     },
+	{ "ds4",    "led_red",                        CFGC_INTEGER, 0,   255   },
+	{ "ds4",    "led_green",                      CFGC_INTEGER, 0,   255   },
+	{ "ds4",    "led_blue",                       CFGC_INTEGER, 0,   255   },
+	{ "ds4",    "triangle_pressure",              CFGC_INTEGER, 1,   255   },
+	{ "ds4",    "circle_pressure",                CFGC_INTEGER, 1,   255   },
+	{ "ds4",    "cross_pressure",                 CFGC_INTEGER, 1,   255   },
+	{ "ds4",    "square_pressure",                CFGC_INTEGER, 1,   255   },
+	{ "ds4",    "analog_range_emulation_default", CFGC_BOOLEAN, 0,   0     },
+	{ "ds4",    "analog_range_emulation_divisor", CFGC_DECIMAL, 0.1, 1.0   }
+};
+
+static const char  *cfgc_path;
+static unsigned int cfgc_errors;
+static unsigned int cfgc_warnings;
+
+static void cfgc_report(unsigned int line, int error, const char *format, const char *a, const char *b)
+{
+	printf("%s:%u: %s: ", cfgc_path, line, error ? "error" : "warning");
+	printf(format, a, b);
+	printf("\n");
+	
+	if (error)
+	{
+		cfgc_errors++;
+	}
+	else
+	{
+		cfgc_warnings++;
+	}
+}
+
+/* Copies a view to a terminated buffer for messages and conversions */
+static const char *cfgc_text(const ini_view *view, char *buffer, size_t size)
+{
+	size_t length = (view->length < size - 1) ? view->length : size - 1;
+	
+	if (view->text)
+	{
+		memcpy(buffer, view->text, length);
+	}
+	else
+	{
+		length = 0;
+	}
+	
+	buffer[length] = '\0';
+	
+	return buffer;
+}
+
+static int cfgc_control(const ini_view *view)
+{
+	return controller_map_string_to_offset(view->text, view->length);
+}
+
+static int cfgc_same(const ini_view *a, const ini_view *b)
+{
+	return a->length == b->length && (!a->length || !memcmp(a->text, b->text, a->length));
+}
+
+static void cfgc_check_value(unsigned int line, const cfgc_rule *rule, const ini_view *value)
+{
+	char  text[64];
+	char  range[64];
+	char *end;
+	
+	cfgc_text(value, text, sizeof(text));
+	
+	switch (rule->type)
+	{
+		case CFGC_INTEGER:
+		case CFGC_DECIMAL:
+		{
+			double number = (rule->type == CFGC_INTEGER) ? (double)strtol(text, &end, 10) : strtod(text, &end);
+			
+			if (rule->type == CFGC_INTEGER)
+			{
+				sprintf(range, "%.0f-%.0f", rule->min, rule->max);
+			}
+			else
+			{
+				sprintf(range, "%.1f-%.1f", rule->min, rule->max);
+			}
+			
+			if (!value->length || end == text || *end || value->length >= sizeof(text))
+			{
+				cfgc_report(line, 1, "'%s' is not a number in the range %s", text, range);
+			}
+			else if (number < rule->min || number > rule->max)
+			{
+				cfgc_report(line, 1, "%s is outside the range %s and will be clamped", text, range);
+			}
+			
+			break;
+		}
+		
+		case CFGC_BOOLEAN:
+			if (!ini_view_equals(value, "true") && !ini_view_equals(value, "false"))
+			{
+				cfgc_report(line, 1, "'%s' is not true or false%s", text, " and is read as false");
+			}
+			
+			break;
+		
+		case CFGC_SWITCH:
+			if (!ini_view_equals(value, "on") && !ini_view_equals(value, "off"))
+			{
+				cfgc_report(line, 1, "'%s' is not on or off%s", text, " and is read as off");
+			}
+			
+			break;
+		
+		case CFGC_CONTROL:
+			if (value->length && cfgc_control(value) == -1)
+			{
+				cfgc_report(line, 1, "'%s' is not a control name%s", text, " - the control will do nothing");
+			}
+			
+			break;
+	}
+}
+
+/* Returns non-zero for custom_mapping or the custom_mapping.<address> section of one controller */
+static int cfgc_mapping_section(const ini_view *section)
+{
+	unsigned int i;
+	
+	if (ini_view_equals(section, "custom_mapping"))
+	{
+		return 1;
+	}
+	
+	if (section->length != 32 || memcmp(section->text, "custom_mapping.", 15))
+	{
+		return 0;
+	}
+	
+	for (i = 0; i < 17; i++)
+	{
+		char c = section->text[15 + i];
+		
+		if ((i % 3 == 2) ? (c != ':') : !strchr("0123456789abcdefABCDEF", c))
+		{
+			return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/* Returns the rule for a key or NULL when cfg_file_read() never looks it up */
+static const cfgc_rule *cfgc_find_rule(const ini_view_key *key)
+{
+	static cfgc_rule control = { "custom_mapping", NULL, CFGC_CONTROL, 0, 0 };
+	unsigned int     i;
+	
+	if (!key->section.text)
+	{
+		return NULL;
+	}
+	
+	if (cfgc_mapping_section(&key->section))
+	{
+		return (cfgc_control(&key->key) != -1) ? &control : NULL;
+	}
+	
+	for (i = 0; i < sizeof(cfgc_rules) / sizeof(cfgc_rules[0]); i++)
+	{
+		if (ini_view_equals(&key->section, cfgc_rules[i].section) && ini_view_equals(&key->key, cfgc_rules[i].key))
+		{
+			return &cfgc_rules[i];
+		}
+	}
+	
+	return NULL;
+}
+
+static int cfgc_known_section(const ini_view *section)
+{
+	unsigned int i;
+	
+	for (i = 0; i < sizeof(cfgc_rules) / sizeof(cfgc_rules[0]); i++)
+	{
+		if (ini_view_equals(section, cfgc_rules[i].section))
+		{
+			return 1;
+		}
+	}
+	
+	return cfgc_mapping_section(section);
+}
+
+/* Line number of a position in the mapped file */
+static unsigned int cfgc_line(ini_view_file *file, const char *text)
+{
+	const char  *s = file->map;
+	unsigned int line = 1;
+	
+	while (s < text)
+	{
+		line += (*s++ == '\n');
+	}
+	
+	return line;
+}
+
+static void cfgc_validate(ini_view_file *file)
+{
+	const char  *s = file->map;
+	unsigned int line = 1;
+	unsigned int i, j;
+	
+	for (i = 0; i < file->count; i++)
+	{
+		ini_view_key    *key = &file->keys[i];
+		const cfgc_rule *rule;
+		char             name[64];
+		char             section[64];
+		
+		/* Keys are in file order so lines are counted in one pass */
+		while (s < key->key.text)
+		{
+			line += (*s++ == '\n');
+		}
+		
+		cfgc_text(&key->key, name, sizeof(name));
+		cfgc_text(&key->section, section, sizeof(section));
+		
+		for (j = 0; j < i; j++)
+		{
+			ini_view_key *first = &file->keys[j];
+			
+			if (cfgc_same(&first->key, &key->key) && cfgc_same(&first->section, &key->section)
+			&&  !first->section.text == !key->section.text)
+			{
+				break;
+			}
+		}
+		
+		if (j < i)
+		{
+			char first_line[16];
+			
+			/* Only counted again for the rare repeated key */
+			sprintf(first_line, "%u", cfgc_line(file, file->keys[j].key.text));
+			
+			if (cfgc_same(&file->keys[j].value, &key->value))
+			{
+				cfgc_report(line, 0, "%s repeats line %s", name, first_line);
+			}
+			else
+			{
+				cfgc_report(line, 1, "%s conflicts with line %s which is used instead", name, first_line);
+			}
+			
+			continue;
+		}
+		
+		if (!key->section.text)
+		{
+			cfgc_report(line, 1, "%s is outside any section%s", name, " and matches that key in every section");
+		}
+		else if ((rule = cfgc_find_rule(key)))
+		{
+			cfgc_check_value(line, rule, &key->value);
+		}
+		else if (cfgc_known_section(&key->section))
+		{
+			cfgc_report(line, 0, "unknown key %s in [%s]", name, section);
+		}
+		else
+		{
+			cfgc_report(line, 0, "unknown section [%s] (key %s)", section, name);
+		}
+	}
+}
+
+/* Prints what controller_remap() does for each physical control */
+static void cfgc_dump(const cfg_settings *settings)
+{
+	const char *names[24];
+	int         i;
+	
+	memcpy(names, controller_map_offset_to_string, sizeof(names));
+	
+	printf("; Remap program - default pressure %u, deadzone %u\n",
+	       (unsigned int)settings->default_pressure, (unsigned int)settings->analog_to_button_deadzone);
+	
+	for (i = 0; i < 24; i++)
+	{
+		int          target = settings->map.inputs.by_offset[i];
+		unsigned int from = controller_map_offset_to_buffer[i];
+		char         when[32];
+		
+		if (target < 0 || target >= 24)
+		{
+			printf("%-8s -> %-8s nothing\n", names[i], "-");
+			continue;
+		}
+		
+		if (i <= 15)
+		{
+			sprintf(when, "button 0x%04x", (unsigned int)controller_map_offset_to_bitmask[i]);
+		}
+		else if (target <= 15)
+		{
+			sprintf(when, "byte %u %s 0x%02x", from, (i <= 19) ? "<" : ">",
+			        (i <= 19) ? 0x80 - settings->analog_to_button_deadzone : 0x80 + settings->analog_to_button_deadzone);
+		}
+		else
+		{
+			sprintf(when, "byte %u %s 0x80", from, (i <= 19) ? "<" : ">");
+		}
+		
+		printf("%-8s -> %-8s when %-16s ", names[i], names[target], when);
+		
+		if (target <= 15)
+		{
+			printf("set button 0x%04x", (unsigned int)controller_map_offset_to_bitmask[target]);
+		}
+		
+		if (target >= 4 && target <= 15)
+		{
+			unsigned int to = controller_map_offset_to_buffer[target];
+			
+			if (i <= 3)
+			{
+				printf(", byte %u = %u", to, (unsigned int)settings->default_pressure);
+			}
+			else if (i <= 15)
+			{
+				printf(", byte %u = byte %u", to, from);
+			}
+			else
+			{
+				printf(", byte %u = byte %u scaled past the deadzone", to, from);
+			}
+		}
+		else if (target >= 16)
+		{
+			unsigned int to = controller_map_offset_to_buffer[target];
+			int          low = (target <= 19);
+			
+			if (i <= 3)
+			{
+				printf("byte %u = 0x%02x", to, low ? 0x00 : 0xff);
+			}
+			else if (i <= 15)
+			{
+				printf("byte %u = 0x80 %s byte %u / 2", to, low ? "-" : "+", from);
+			}
+			else
+			{
+				printf("byte %u = %sbyte %u", to, (low == (i <= 19)) ? "" : "~", from);
+			}
+		}
+		
+		printf("\n");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	ini_view_file file;
+	ini_error     error;
+	cfg_settings  settings;
+	int           dump = 0;
+	int           usage = 0;
+	int           opt;
+	
+	while ((opt = getopt(argc, argv, "dh")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd': dump = 1;  break;
+			default:  usage = 1; break;
+		}
+	}
+	
+	if (usage || argc - optind != 1)
+	{
+		printf("\nUsage: %s [-d] <settings file>\n\n", argv[0]);
+		printf("  -d  Print the remap program of the custom mapping\n\n");
+		exit(0);
+	}
+	
+	cfgc_path = argv[optind];
+	
+	if ((error = ini_view_open(cfgc_path, &file)) != INI_ERROR_SUCCESS)
+	{
+		fprintf(stderr, "Error reading %s (%d)\n", cfgc_path, (int)error);
+		exit(1);
+	}
+	
+	cfgc_validate(&file);
+	
+	ini_view_close(&file);
+	
+	cfg_file_read(cfgc_path, cfgc_path, &settings);
+	
+	if (dump)
+	{
+		cfgc_dump(&settings);
+	}
+	
+	printf("%s: %u error%s, %u warning%s\n", cfgc_path, cfgc_errors, (cfgc_errors == 1) ? "" : "s",
+	       cfgc_warnings, (cfgc_warnings == 1) ? "" : "s");
+	
+	if (cfgc_errors)
+	{
+		exit(1);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Perfect hash table generator for control names
+	- Built with the host compiler and run by make, which writes its output to
+	  obj/controller_hash.h for src/controller_hash.c
+	- Searches for a seed that gives every name in controller_map_offset_to_string a
+	  slot of its own, starting with the smallest power of two table that holds them
+	  and doubling it when no seed is found */
+
+#include <stdio.h>
+#include <string.h>
+#include "controller.h"
+
+#define NAMES      (sizeof(controller_map_offset_to_string) / sizeof(controller_map_offset_to_string[0]))
+#define SEED_FIRST 2166136261U /* FNV-1a offset basis */
+#define SEED_TRIES 1000000
+
+static uint32_t hash_name(uint32_t seed, const char *name)
+{
+	uint32_t hash = seed;
+	
+	while (*name)
+	{
+		hash = CONTROLLER_HASH_STEP(hash, *name++);
+	}
+	
+	return hash;
+}
+
+/* Fills table and returns 0 when seed places every name in a slot of its own */
+static int try_seed(uint32_t seed, uint32_t mask, int *table)
+{
+	unsigned int i;
+	
+	for (i = 0; i <= mask; i++)
+	{
+		table[i] = -1;
+	}
+	
+	for (i = 0; i < NAMES; i++)
+	{
+		uint32_t slot = CONTROLLER_HASH_SLOT(hash_name(seed, controller_map_offset_to_string[i]), mask);
+		
+		if (table[slot] != -1)
+		{
+			return -1;
+		}
+		
+		table[slot] = (int)i;
+	}
+	
+	return 0;
+}
+
+int main(void)
+{
+	static int   table[1024];
+	uint32_t     size = 1;
+	uint32_t     seed = SEED_FIRST;
+	unsigned int i;
+	
+	while (size < NAMES)
+	{
+		size *= 2;
+	}
+	
+	for (; size <= sizeof(table) / sizeof(table[0]); size *= 2)
+	{
+		for (i = 0, seed = SEED_FIRST; i < SEED_TRIES; i++, seed = (seed + 0x9E3779B9U) & 0xFFFFFFFFU)
+		{
+			if (try_seed(seed, size - 1, table) == 0)
+			{
+				break;
+			}
+		}
+		
+		if (i < SEED_TRIES)
+		{
+			break;
+		}
+	}
+	
+	if (size > sizeof(table) / sizeof(table[0]))
+	{
+		fprintf(stderr, "No perfect hash found for %u control names\n", (unsigned int)NAMES);
+		return 1;
+	}
+	
+	printf("/* Generated by tools/genhash.c from controller_map_offset_to_string - do not edit */\n\n");
+	printf("#define CONTROLLER_HASH_SEED 0x%08XU\n", (unsigned int)seed);
+	printf("#define CONTROLLER_HASH_MASK %u\n\n", (unsigned int)(size - 1));
+	
+	printf("/* Offset of the control hashing to each slot - -1 for an empty slot */\n");
+	printf("static const signed char controller_hash_table[%u] =\n{", (unsigned int)size);
+	
+	for (i = 0; i < size; i++)
+	{
+		printf("%s%3d", (i % 16) ? ", " : ((i) ? ",\n\t" : "\n\t"), table[i]);
+	}
+	
+	printf("\n};\n\n");
+	
+	printf("static const unsigned char controller_hash_length[%u] =\n{", (unsigned int)NAMES);
+	
+	for (i = 0; i < NAMES; i++)
+	{
+		printf("%s%2u", (i % 16) ? ", " : ((i) ? ",\n\t" : "\n\t"), (unsigned int)strlen(controller_map_offset_to_string[i]));
+	}
+	
+	printf("\n};\n");
+	
+	return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* INI parser benchmark on synthetic settings files
+	- Usage: ps2bt-inibench [-s sections] [-k keys] [-r repeats]
+	- Writes a file with the given number of sections and keys per section to /tmp
+	  and times ini_read(), a search for every key and ini_key_list_empty()
+	- The same is timed for the zero-copy parser: ini_view_open(), a search and conversion
+	  of every value and ini_view_close()
+	- Each phase is repeated and the fastest run is reported */
+
+#define _POSIX_C_SOURCE 200809L /* getopt(), clock_gettime(), mkstemp() */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ini.h"
+
+static ini_view_file view;
+static volatile long sink; /* Keeps value conversions from being optimized out */
+
+static int64_t now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void print_phase(const char *name, int64_t best, unsigned long keys)
+{
+	if (best == -1)
+	{
+		printf("%-8s %10s\n", name, "skipped");
+		return;
+	}
+	
+	
+	printf("%-8s %10.3fms %8.1fns/key\n", name, (double)best / 1000000.0, (double)best / (double)keys);
+}
+
+int main(int argc, char **argv)
+{
+	char          path[] = "/tmp/ps2bt-inibench.XXXXXX";
+	unsigned long sections = 64;
+	unsigned long keys = 64;
+	unsigned long repeats = 5;
+	unsigned long i, j, r;
+	int64_t       best_read = -1;
+	int64_t       best_search = -1;
+	int64_t       best_empty = -1;
+	int64_t       best_open = -1;
+	int64_t       best_lookup = -1;
+	int64_t       best_close = -1;
+	unsigned long found = 0;
+	unsigned long found_view = 0;
+	FILE         *file;
+	int           fd;
+	int           opt;
+	
+	while ((opt = getopt(argc, argv, "s:k:r:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': sections = strtoul(optarg, NULL, 10); break;
+			case 'k': keys = strtoul(optarg, NULL, 10);     break;
+			case 'r': repeats = strtoul(optarg, NULL, 10);  break;
+			default:  repeats = 0;                          break;
+		}
+	}
+	
+	if (!sections || !keys || !repeats || optind != argc)
+	{
+		printf("\nUsage: %s [-s sections] [-k keys] [-r repeats]\n\n", argv[0]);
+		printf("  -s  Sections in the file (default 64)\n");
+		printf("  -k  Keys in each section (default 64)\n");
+		printf("  -r  Runs of each phase, the fastest is reported (default 5)\n\n");
+		exit(0);
+	}
+	
+	if ((fd = mkstemp(path)) == -1 || !(file = fdopen(fd, "w")))
+	{
+		fprintf(stderr, "Error creating %s\n", path);
+		exit(1);
+	}
+	
+	/* Same shape as settings.cfg - short names and values with comments between sections */
+	for (i = 0; i < sections; i++)
+	{
+		fprintf(file, "; Section %lu\r\n[section_%lu]\r\n", i, i);
+		
+		for (j = 0; j < keys; j++)
+		{
+			fprintf(file, "key_%lu=value_%lu_%lu\r\n", j, i, j);
+		}
+		
+		fprintf(file, "\r\n");
+	}
+	
+	fclose(file);
+	
+	for (r = 0; r < repeats; r++)
+	{
+		ini_key_list list;
+		int64_t      start;
+		int64_t      elapsed;
+		
+		memset(&list, 0, sizeof(list));
+		
+		start = now();
+		
+		if (ini_read(path, &list) != INI_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "Error reading %s\n", path);
+			remove(path);
+			exit(1);
+		}
+		
+		elapsed = now() - start;
+		best_read = (best_read == -1 || elapsed < best_read) ? elapsed : best_read;
+		
+		found = 0;
+		start = now();
+		
+		for (i = 0; i < sections; i++)
+		{
+			char section[32];
+			
+			sprintf(section, "section_%lu", i);
+			
+			for (j = 0; j < keys; j++)
+			{
+				char key[32];
+				
+				sprintf(key, "key_%lu", j);
+				
+				found += (ini_key_list_search(&list, section, key) != NULL);
+			}
+		}
+		
+		elapsed = now() - start;
+		best_search = (best_search == -1 || elapsed < best_search) ? elapsed : best_search;
+		
+		start = now();
+		ini_key_list_empty(&list);
+		elapsed = now() - start;
+		best_empty = (best_empty == -1 || elapsed < best_empty) ? elapsed : best_empty;
+		
+		start = now();
+		
+		if (ini_view_open(path, &view) != INI_ERROR_SUCCESS)
+		{
+			fprintf(stderr, "Error mapping %s\n", path);
+			remove(path);
+			exit(1);
+		}
+		
+		elapsed = now() - start;
+		best_open = (best_open == -1 || elapsed < best_open) ? elapsed : best_open;
+		
+		found_view = 0;
+		start = now();
+		
+		for (i = 0; i < sections; i++)
+		{
+			char section[32];
+			
+			sprintf(section, "section_%lu", i);
+			
+			for (j = 0; j < keys; j++)
+			{
+				char            key[32];
+				const ini_view *value;
+				
+				sprintf(key, "key_%lu", j);
+				
+				if ((value = ini_view_search(&view, section, key)))
+				{
+					/* Converting each value is the work the list does up front */
+					sink = ini_view_long(value);
+					found_view++;
+				}
+			}
+		}
+		
+		elapsed = now() - start;
+		best_lookup = (best_lookup == -1 || elapsed < best_lookup) ? elapsed : best_lookup;
+		
+		start = now();
+		ini_view_close(&view);
+		elapsed = now() - start;
+		best_close = (best_close == -1 || elapsed < best_close) ? elapsed : best_close;
+	}
+	
+	remove(path);
+	
+	printf("%lu sections x %lu keys, %lu found, best of %lu\n", sections, keys, found, repeats);
+	print_phase("read", best_read, sections * keys);
+	print_phase("search", best_search, sections * keys);
+	print_phase("empty", best_empty, sections * keys);
+	print_phase("open", best_open, sections * keys);
+	print_phase("lookup", best_lookup, sections * keys);
+	print_phase("close", best_close, sections * keys);
+	
+	return (found == sections * keys && (best_open == -1 || found_view == found)) ? 0 : 1;
+}
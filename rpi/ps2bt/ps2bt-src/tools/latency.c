@@ -0,0 +1,277 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Input to wire latency from a ps2bt-uinput stamp log and a ps2pty wire log
+	- Usage: ps2bt-latency <stamp log> <wire log> [name]
+	- Both logs use CLOCK_MONOTONIC so they can be compared directly
+	- A report is matched to the first wire event carrying its stamp after it was injected
+	  and before the stamp is reused 256 reports later
+	- Reports which never appear were replaced by a newer report before ps2bt sent them
+	  and are counted as superseded
+	- Two stages are reported as one JSON object on stdout
+		serial - the packet carrying the report reached the Teensy
+		poll   - the console read the report in an analog poll
+	- Jitter is the standard deviation of the latency */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define STAMPS 256
+
+typedef struct
+{
+	int64_t *times;
+	size_t   size;
+	size_t   capacity;
+} time_list;
+
+typedef struct
+{
+	time_list stamps[STAMPS]; /* Times at which each stamp value was seen */
+	size_t    next[STAMPS];   /* Matching cursor into each list */
+} wire_stage;
+
+static int time_list_append(time_list *list, int64_t time)
+{
+	if (list->size == list->capacity)
+	{
+		size_t   capacity = list->capacity ? list->capacity * 2 : 64;
+		int64_t *times;
+		
+		if (!(times = realloc(list->times, capacity * sizeof(int64_t))))
+		{
+			return -1;
+		}
+		
+		list->times = times;
+		list->capacity = capacity;
+	}
+	
+	list->times[list->size++] = time;
+	
+	return 0;
+}
+
+/* Times are "seconds.nanoseconds" */
+static int parse_time(const char *text, int64_t *time)
+{
+	long seconds;
+	long nanoseconds;
+	
+	if (sscanf(text, "%ld.%ld", &seconds, &nanoseconds) != 2)
+	{
+		return -1;
+	}
+	
+	*time = (int64_t)seconds * 1000000000 + nanoseconds;
+	
+	return 0;
+}
+
+static int compare_times(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	
+	return (x > y) - (x < y);
+}
+
+static int read_wire(const char *path, wire_stage *serial, wire_stage *poll)
+{
+	FILE *file;
+	char  line[128];
+	
+	if (!(file = fopen(path, "r")))
+	{
+		fprintf(stderr, "Error opening %s\n", path);
+		return -1;
+	}
+	
+	while (fgets(line, sizeof(line), file))
+	{
+		char         time_text[32];
+		char         event[16];
+		unsigned int stamp;
+		int64_t      time;
+		wire_stage  *stage;
+		
+		if (sscanf(line, "%31s %15s %u", time_text, event, &stamp) != 3
+		||  parse_time(time_text, &time) == -1 || stamp >= STAMPS)
+		{
+			continue;
+		}
+		
+		stage = !strcmp(event, "packet") ? serial : (!strcmp(event, "poll") ? poll : NULL);
+		
+		if (stage && time_list_append(&stage->stamps[stamp], time) == -1)
+		{
+			fclose(file);
+			return -1;
+		}
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
+
+static int read_stamps(const char *path, time_list *injected)
+{
+	FILE *file;
+	char  line[128];
+	
+	if (!(file = fopen(path, "r")))
+	{
+		fprintf(stderr, "Error opening %s\n", path);
+		return -1;
+	}
+	
+	while (fgets(line, sizeof(line), file))
+	{
+		unsigned long sequence;
+		char          time_text[32];
+		unsigned int  stamp;
+		int64_t       time;
+		
+		if (sscanf(line, "%lu %31s %u", &sequence, time_text, &stamp) != 3 || parse_time(time_text, &time) == -1)
+		{
+			continue;
+		}
+		
+		/* The sequence is the index so gaps cannot shift the stamps */
+		while (injected->size < sequence)
+		{
+			if (time_list_append(injected, -1) == -1)
+			{
+				fclose(file);
+				return -1;
+			}
+		}
+		
+		if (time_list_append(injected, time) == -1)
+		{
+			fclose(file);
+			return -1;
+		}
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
+
+static void print_stage(const char *name, time_list *injected, wire_stage *stage)
+{
+	time_list latency;
+	size_t    i;
+	size_t    superseded = 0;
+	double    mean = 0;
+	double    deviation = 0;
+	
+	memset(&latency, 0, sizeof(latency));
+	
+	for (i = 0; i < injected->size; i++)
+	{
+		time_list *seen = &stage->stamps[i % STAMPS];
+		size_t    *next = &stage->next[i % STAMPS];
+		int64_t    start = injected->times[i];
+		int64_t    reuse = (i + STAMPS < injected->size) ? injected->times[i + STAMPS] : -1;
+		
+		if (start == -1)
+		{
+			continue;
+		}
+		
+		while (*next < seen->size && seen->times[*next] < start)
+		{
+			(*next)++;
+		}
+		
+		if (*next < seen->size && (reuse == -1 || seen->times[*next] < reuse))
+		{
+			time_list_append(&latency, seen->times[*next] - start);
+		}
+		else
+		{
+			superseded++;
+		}
+	}
+	
+	printf("\"%s\": { \"matched\": %lu, \"superseded\": %lu", name,
+	       (unsigned long)latency.size, (unsigned long)superseded);
+	
+	if (latency.size)
+	{
+		for (i = 0; i < latency.size; i++)
+		{
+			mean += (double)latency.times[i];
+		}
+		
+		mean /= (double)latency.size;
+		
+		for (i = 0; i < latency.size; i++)
+		{
+			deviation += ((double)latency.times[i] - mean) * ((double)latency.times[i] - mean);
+		}
+		
+		deviation = sqrt(deviation / (double)latency.size);
+		
+		qsort(latency.times, latency.size, sizeof(int64_t), compare_times);
+		
+		printf(", \"min_us\": %.1f, \"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f"
+		       ", \"mean_us\": %.1f, \"jitter_us\": %.1f",
+		       (double)latency.times[0] / 1000.0,
+		       (double)latency.times[latency.size / 2] / 1000.0,
+		       (double)latency.times[(latency.size * 99) / 100] / 1000.0,
+		       (double)latency.times[latency.size - 1] / 1000.0,
+		       mean / 1000.0, deviation / 1000.0);
+	}
+	
+	printf(" }");
+	
+	free(latency.times);
+}
+
+int main(int argc, char **argv)
+{
+	static wire_stage serial;
+	static wire_stage poll;
+	time_list         injected;
+	
+	if (argc != 3 && argc != 4)
+	{
+		printf("\nUsage: %s <stamp log> <wire log> [name]\n\n", argv[0]);
+		exit(0);
+	}
+	
+	memset(&injected, 0, sizeof(injected));
+	
+	if (read_stamps(argv[1], &injected) == -1 || read_wire(argv[2], &serial, &poll) == -1)
+	{
+		exit(1);
+	}
+	
+	printf("{ \"name\": \"%s\", \"reports\": %lu, ", (argc == 4) ? argv[3] : "", (unsigned long)injected.size);
+	print_stage("serial", &injected, &serial);
+	printf(", ");
+	print_stage("poll", &injected, &poll);
+	printf(" }\n");
+	
+	return 0;
+}
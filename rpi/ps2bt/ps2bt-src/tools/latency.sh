@@ -0,0 +1,210 @@
+#! /bin/sh
+
+#
+# Latency harness - measures input to wire latency of ps2bt for each configuration
+#
+# Usage: tools/latency.sh [-s seconds] [-o results.json] <configuration file>
+#
+# Each configuration injects stamped reports through a virtual controller (bin/ps2bt-uinput),
+# runs a ps2bt binary against it and a Teensy stand-in on a pty (ps2pty from teensy/simulator)
+# and prints one JSON object per configuration from bin/ps2bt-latency as a JSON array
+#
+# Configuration lines are "<name> [key=value ...]", # starts a comment
+#   binary=path       ps2bt binary, compare builds such as different loop rates or input
+#                     backends by building them to different paths (default bin/ps2bt)
+#   layout=3|4        Dualshock layout (default 3)
+#   rate=hz           Input report rate (default 250)
+#   profile=name      ps2bt-uinput profile (default sticks)
+#   poll=hz           Console poll rate (default 60)
+#   frame_sync=bool   frame_sync setting (default true)
+#   guard=us          frame_sync_guard setting (default 2000)
+#   pty="options"     Extra ps2pty options such as -c or -j 500
+#
+# Requires root for /dev/uinput and writes /tmp/settings.cfg for each configuration
+#
+
+# Paths
+root=$(cd "$(dirname "$0")/.." && pwd)
+uinput="$root/bin/ps2bt-uinput"
+latency="$root/bin/ps2bt-latency"
+ps2pty="${PS2PTY:-$root/../../../teensy/simulator/ps2pty}"
+settings=/tmp/settings.cfg
+work=$(mktemp -d /tmp/ps2bt-latency.XXXXXX)
+
+seconds=10
+output=
+
+while getopts "s:o:" opt
+do
+	case "$opt" in
+		s) seconds="$OPTARG" ;;
+		o) output="$OPTARG" ;;
+		*) exit 2 ;;
+	esac
+done
+
+shift $((OPTIND - 1))
+
+if [ $# -ne 1 ]
+then
+	echo "Usage: $0 [-s seconds] [-o results.json] <configuration file>" >&2
+	exit 2
+fi
+
+for tool in "$uinput" "$latency" "$ps2pty"
+do
+	if [ ! -x "$tool" ]
+	then
+		echo "$tool not found - run make tools here and make in teensy/simulator" >&2
+		exit 1
+	fi
+done
+
+# Keep any existing settings
+if [ -e "$settings" ]
+then
+	cp "$settings" "$work/settings.cfg.saved"
+fi
+
+cleanup()
+{
+	if [ -e "$work/settings.cfg.saved" ]
+	then
+		cp "$work/settings.cfg.saved" "$settings"
+	else
+		rm -f "$settings"
+	fi
+
+	rm -rf "$work"
+}
+
+trap cleanup EXIT
+trap "exit 1" INT TERM
+
+# Runs one configuration and prints its JSON object
+run()
+{
+	name="$1"
+	shift
+
+	binary="$root/bin/ps2bt"
+	layout=3
+	rate=250
+	profile=sticks
+	poll=60
+	frame_sync=true
+	guard=2000
+	pty=
+
+	for option in "$@"
+	do
+		case "$option" in
+			binary=*|layout=*|rate=*|profile=*|poll=*|frame_sync=*|guard=*|pty=*)
+				eval "${option%%=*}=\"\${option#*=}\"" ;;
+			*)
+				echo "$name: unknown option $option" >&2
+				return 1 ;;
+		esac
+	done
+
+	# DS4 range emulation would move the stamps on the left stick
+	cat > "$settings" <<-EOF
+		[common]
+		frame_sync=$frame_sync
+		frame_sync_guard=$guard
+
+		[ds4]
+		analog_range_emulation_default=false
+	EOF
+
+	echo "1500 analog" > "$work/pty.txt" # Once ps2bt is connected
+	rm -f "$work/stamps.log" "$work/wire.log" "$work/nodes"
+
+	"$ps2pty" -l "$work/tty" -r "$poll" -s "$work/pty.txt" -w "$work/wire.log" $pty > "$work/pty.out" &
+	pty_pid=$!
+
+	"$uinput" -t "$layout" -r "$rate" -p "$profile" -d 2000 -n $((rate * seconds)) \
+	          -l "$work/stamps.log" > "$work/nodes" &
+	uinput_pid=$!
+
+	# Wait until the virtual controller and pty are ready
+	tries=0
+
+	while true
+	do
+		joystick=$(sed -n 's/^joystick //p' "$work/nodes")
+		event=$(sed -n 's/^event //p' "$work/nodes")
+
+		if [ -n "$joystick" ] && [ -e "$joystick" ] && [ -n "$event" ] && [ -e "$event" ] && [ -e "$work/tty" ]
+		then
+			break
+		fi
+
+		tries=$((tries + 1))
+
+		if [ $tries -gt 20 ]
+		then
+			echo "$name: devices did not appear" >&2
+			kill $pty_pid $uinput_pid 2>/dev/null
+			wait
+			return 1
+		fi
+
+		sleep 0.1
+	done
+
+	"$binary" "$joystick" "$event" "$work/tty" > /dev/null &
+	ps2bt_pid=$!
+
+	wait $uinput_pid
+
+	# Give the last reports time to reach the wire
+	sleep 0.5
+
+	kill $ps2bt_pid $pty_pid 2>/dev/null
+	wait
+
+	"$latency" "$work/stamps.log" "$work/wire.log" "$name"
+}
+
+# Collect results as a JSON array
+{
+	echo "["
+
+	first=1
+
+	while read -r line
+	do
+		line="${line%%#*}"
+
+		if [ -z "$(echo $line)" ]
+		then
+			continue
+		fi
+
+		eval "set -- $line"
+
+		echo "Running $1" >&2
+
+		if result=$(run "$@")
+		then
+			if [ $first -eq 0 ]
+			then
+				echo ","
+			fi
+
+			printf "  %s" "$result"
+			first=0
+		fi
+	done < "$1"
+
+	echo
+	echo "]"
+} > "$work/results.json"
+
+if [ -n "$output" ]
+then
+	cp "$work/results.json" "$output"
+else
+	cat "$work/results.json"
+fi
@@ -0,0 +1,145 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Prints the live state ps2bt publishes in /dev/shm
+	- Usage: ps2bt-monitor [-r rate] [-n count] [file]
+	- Reading only touches shared memory so it never slows ps2bt down
+	- Samples where ps2bt has not run a new frame are skipped */
+
+#define _POSIX_C_SOURCE 200112L /* getopt(), clock_nanosleep() */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "live.h"
+
+#define MAX_RATE 1000
+
+static void print_bytes(const char *name, const uint8_t *bytes, unsigned int size)
+{
+	unsigned int i;
+	
+	printf("  %-10s", name);
+	
+	for (i = 0; i < size; i++)
+	{
+		printf(" %02x", bytes[i]);
+	}
+	
+	printf("\n");
+}
+
+static void print_state(const live_data *data)
+{
+	unsigned int i;
+	
+	printf("frame %lu time %ld.%09ld DS%u\n", (unsigned long)data->frames,
+	       (long)(data->time / 1000000000), (long)(data->time % 1000000000), (unsigned int)data->type);
+	
+	printf("  %-10s buttons %05lx axes", "joystick", (unsigned long)data->joystick.buttons);
+	
+	for (i = 0; i < 16; i++)
+	{
+		printf(" %d", data->joystick.axes.buffer[i]);
+	}
+	
+	printf("\n  %-10s buttons %04x axes", "controller", (unsigned int)data->controller.buttons);
+	
+	for (i = 0; i < 16; i++)
+	{
+		printf(" %u", (unsigned int)data->controller.axes.buffer[i]);
+	}
+	
+	printf("\n");
+	
+	print_bytes("packet", data->packet, SEND_PACKET_SIZE);
+	print_bytes("reply", data->reply, RECV_PACKET_SIZE);
+	
+	printf("  %-10s %s period %.3fms error %.3fms\n", "sync", data->sync_locked ? "locked" : "unlocked",
+	       (double)data->sync_period / 1000000.0, (double)data->sync_error / 1000000.0);
+	printf("  %-10s %lu timeouts %lu\n\n", "replies", (unsigned long)data->replies, (unsigned long)data->timeouts);
+	
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	const char     *path = LIVE_FILE;
+	unsigned long   rate = 10;
+	unsigned long   count = 0;
+	unsigned long   printed = 0;
+	uint64_t        last_frame = 0;
+	live_state     *state;
+	live_data       data;
+	struct timespec due;
+	int             opt;
+	
+	while ((opt = getopt(argc, argv, "r:n:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'r': rate = strtoul(optarg, NULL, 10);  break;
+			case 'n': count = strtoul(optarg, NULL, 10); break;
+			default:  rate = 0;                          break;
+		}
+	}
+	
+	if (rate < 1 || rate > MAX_RATE || argc - optind > 1)
+	{
+		printf("\nUsage: %s [-r rate] [-n count] [file]\n\n", argv[0]);
+		printf("  -r  Samples per second, 1 to %d (default 10)\n", MAX_RATE);
+		printf("  -n  Exit after printing this many samples (default 0 - run until interrupted)\n");
+		printf("  file defaults to %s\n\n", LIVE_FILE);
+		exit(0);
+	}
+	
+	if (optind < argc)
+	{
+		path = argv[optind];
+	}
+	
+	if (!(state = live_open(path)))
+	{
+		fprintf(stderr, "Error opening %s - is ps2bt running?\n", path);
+		exit(1);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &due);
+	
+	while (!count || printed < count)
+	{
+		if (live_read(state, &data) == 0 && data.frames != last_frame)
+		{
+			print_state(&data);
+			last_frame = data.frames;
+			printed++;
+		}
+		
+		due.tv_nsec += (long)(1000000000 / rate);
+		
+		if (due.tv_nsec >= 1000000000)
+		{
+			due.tv_sec++;
+			due.tv_nsec -= 1000000000;
+		}
+		
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0) continue;
+	}
+	
+	return 0;
+}
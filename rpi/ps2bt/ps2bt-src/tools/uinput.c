@@ -0,0 +1,646 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Virtual Dualshock for benchmarking ps2bt without a controller
+	- Creates a uinput device with the DS3 (19 buttons, 27 axes) or DS4 (14 buttons, 18 axes)
+	  layout so joystick_init() detects it the same way as the real controller
+	- Button and axis numbers are the joystick (js_event) numbers ps2bt sees
+	- Reports are driven by a built-in profile, a script or a recording of a real controller
+	- Every report is written with a single write() and stamped with the monotonic time
+	  immediately before it is injected
+	- When stamping, the left stick X axis carries the low byte of the report sequence number
+	  so the report can be identified on the wire (byte 5 of the serial packet)
+	- DS4 stamps only survive with analog_range_emulation_default=false */
+
+#define _POSIX_C_SOURCE 200112L /* clock_nanosleep(), sigaction() */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <linux/joystick.h>
+
+#define UINPUT_PATH       "/dev/uinput"
+#define MAX_BUTTONS       19
+#define MAX_AXES          27
+#define MAX_RATE          1000
+#define AXIS_MIN          -32767
+#define AXIS_MAX          32767
+#define BUTTON_BASE       BTN_TRIGGER /* Consecutive codes from here keep joydev's button numbering */
+#define STAMP_AXIS        0           /* Left stick X on both layouts */
+
+typedef struct
+{
+	const char  *name;
+	unsigned int type;        /* Dualshock type (3 or 4) */
+	unsigned int buttons;
+	unsigned int pad_buttons; /* Buttons past these are PS and touchpad which switch ps2bt's modes */
+	unsigned int axes;
+	uint16_t     product;
+	int          axis_rest[MAX_AXES];
+} layout;
+
+/* DS3 - pressure axes (8 - 19) rest at the minimum
+   DS4 - L2/R2 (3, 4) rest at the minimum */
+static const layout layouts[2] =
+{
+	{
+		"ps2bt virtual DS3", 3, 19, 16, 27, 0x0268,
+		{      0,      0,      0,      0,      0,      0,      0,      0,
+		  -32767, -32767, -32767, -32767, -32767, -32767, -32767, -32767,
+		  -32767, -32767, -32767, -32767,      0,      0,      0,      0,
+		       0,      0,      0 }
+	},
+	{
+		"ps2bt virtual DS4", 4, 14, 12, 18, 0x05C4,
+		{      0,      0,      0, -32767, -32767,      0,      0,      0,
+		       0,      0,      0,      0,      0,      0,      0,      0,
+		       0,      0 }
+	}
+};
+
+typedef struct
+{
+	int buttons[MAX_BUTTONS];
+	int axes[MAX_AXES];
+} report;
+
+static volatile sig_atomic_t quit = 0;
+
+static void handle_signal(int signal)
+{
+	(void)signal;
+	quit = 1;
+}
+
+static int64_t monotonic_time(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static void sleep_until(int64_t time)
+{
+	struct timespec t;
+	t.tv_sec = (time_t)(time / 1000000000);
+	t.tv_nsec = (long)(time % 1000000000);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0 && !quit) continue;
+}
+
+/* The stamp is centered in its byte so joydev's scaling cannot move it into a neighbour */
+static int stamp_value(uint32_t sequence)
+{
+	return (int)(sequence & 0xFF) * 256 - 32768 + 128;
+}
+
+static int uinput_create(const layout *l)
+{
+	int                    fd;
+	unsigned int           i;
+	struct uinput_user_dev dev;
+	
+	if ((fd = open(UINPUT_PATH, O_WRONLY | O_NONBLOCK)) == -1)
+	{
+		fprintf(stderr, "Error opening %s: %s\n", UINPUT_PATH, strerror(errno));
+		return -1;
+	}
+	
+	memset(&dev, 0, sizeof(dev));
+	
+	strncpy(dev.name, l->name, UINPUT_MAX_NAME_SIZE - 1);
+	dev.id.bustype = BUS_VIRTUAL;
+	dev.id.vendor = 0x054C;
+	dev.id.product = l->product;
+	dev.id.version = 1;
+	
+	/* No fuzz or flat so every injected value reaches joydev unfiltered */
+	for (i = 0; i < l->axes; i++)
+	{
+		dev.absmin[i] = AXIS_MIN;
+		dev.absmax[i] = AXIS_MAX;
+	}
+	
+	if (ioctl(fd, UI_SET_EVBIT, EV_KEY) == -1
+	||  ioctl(fd, UI_SET_EVBIT, EV_ABS) == -1
+	||  ioctl(fd, UI_SET_EVBIT, EV_SYN) == -1)
+	{
+		fprintf(stderr, "Error configuring %s: %s\n", UINPUT_PATH, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	
+	for (i = 0; i < l->buttons; i++)
+	{
+		if (ioctl(fd, UI_SET_KEYBIT, BUTTON_BASE + i) == -1)
+		{
+			fprintf(stderr, "Error configuring %s: %s\n", UINPUT_PATH, strerror(errno));
+			close(fd);
+			return -1;
+		}
+	}
+	
+	for (i = 0; i < l->axes; i++)
+	{
+		if (ioctl(fd, UI_SET_ABSBIT, i) == -1)
+		{
+			fprintf(stderr, "Error configuring %s: %s\n", UINPUT_PATH, strerror(errno));
+			close(fd);
+			return -1;
+		}
+	}
+	
+	if (write(fd, &dev, sizeof(dev)) != sizeof(dev) || ioctl(fd, UI_DEV_CREATE) == -1)
+	{
+		fprintf(stderr, "Error creating uinput device: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+/* Prints the joystick and event nodes to pass to ps2bt */
+static void uinput_print_nodes(int fd)
+{
+	#ifdef UI_GET_SYSNAME
+	{
+		char           sysname[64];
+		char           path[128];
+		DIR           *d;
+		struct dirent *entry;
+		
+		memset(sysname, 0, sizeof(sysname));
+		
+		if (ioctl(fd, UI_GET_SYSNAME(sizeof(sysname) - 1), sysname) == -1)
+		{
+			return;
+		}
+		
+		sprintf(path, "/sys/devices/virtual/input/%s", sysname);
+		
+		if (!(d = opendir(path)))
+		{
+			return;
+		}
+		
+		while ((entry = readdir(d)))
+		{
+			if (!strncmp(entry->d_name, "js", 2))
+			{
+				printf("joystick /dev/input/%s\n", entry->d_name);
+			}
+			else if (!strncmp(entry->d_name, "event", 5))
+			{
+				printf("event /dev/input/%s\n", entry->d_name);
+			}
+		}
+		
+		closedir(d);
+		fflush(stdout);
+	}
+	#else
+		(void)fd;
+	#endif
+}
+
+/* Only changed controls are written - the input core drops repeated values anyway */
+static int uinput_send(int fd, const layout *l, report *current, report *previous)
+{
+	struct input_event events[MAX_BUTTONS + MAX_AXES + 1];
+	unsigned int       count;
+	unsigned int       i;
+	
+	memset(events, 0, sizeof(events));
+	
+	count = 0;
+	
+	for (i = 0; i < l->buttons; i++)
+	{
+		if (current->buttons[i] != previous->buttons[i])
+		{
+			events[count].type = EV_KEY;
+			events[count].code = BUTTON_BASE + i;
+			events[count].value = current->buttons[i];
+			count++;
+		}
+	}
+	
+	for (i = 0; i < l->axes; i++)
+	{
+		if (current->axes[i] != previous->axes[i])
+		{
+			events[count].type = EV_ABS;
+			events[count].code = i;
+			events[count].value = current->axes[i];
+			count++;
+		}
+	}
+	
+	events[count].type = EV_SYN;
+	events[count].code = SYN_REPORT;
+	events[count].value = 0;
+	count++;
+	
+	*previous = *current;
+	
+	count *= sizeof(struct input_event);
+	
+	return (write(fd, events, count) == (ssize_t)count) ? 0 : -1;
+}
+
+/* Profiles
+	- idle     - nothing changes (only the stamp when stamping)
+	- buttons  - one button is pressed at a time, walking through all of them
+	- sticks   - both sticks sweep in opposite directions
+	- axes     - every axis changes on every report
+	- all      - every axis and every button changes on every report (worst case)
+   PS and touchpad are left alone since they switch ps2bt's modes */
+static int profile_lookup(const char *name)
+{
+	const char  *names[5] = { "idle", "buttons", "sticks", "axes", "all" };
+	unsigned int i;
+	
+	for (i = 0; i < 5; i++)
+	{
+		if (!strcmp(name, names[i]))
+		{
+			return (int)i;
+		}
+	}
+	
+	return -1;
+}
+
+static void profile_apply(int profile, const layout *l, uint32_t sequence, report *r)
+{
+	unsigned int i;
+	
+	switch (profile)
+	{
+		case 1:
+		{
+			for (i = 0; i < l->pad_buttons; i++)
+			{
+				r->buttons[i] = (i == sequence % l->pad_buttons);
+			}
+			
+			break;
+		}
+		case 2:
+		{
+			int sweep = (int)((sequence * 257) % 65535) - 32767;
+			
+			r->axes[0] = sweep;
+			r->axes[1] = sweep;
+			r->axes[2] = -sweep;
+			r->axes[l->type == 3 ? 3 : 5] = -sweep;
+			
+			break;
+		}
+		case 3:
+		case 4:
+		{
+			/* Consecutive values differ by 97 so no axis ever repeats its previous value */
+			for (i = 0; i < l->axes; i++)
+			{
+				r->axes[i] = (int)((sequence * 97 + i * 1031) % 65535) - 32767;
+			}
+			
+			if (profile == 4)
+			{
+				for (i = 0; i < l->pad_buttons; i++)
+				{
+					r->buttons[i] = (int)((sequence + i) & 1);
+				}
+			}
+			
+			break;
+		}
+	}
+}
+
+/* Script format - one command per line, '#' starts a comment
+	button <number> <0|1>   - set a button
+	axis <number> <value>   - set an axis (-32767 to 32767)
+	wait <ms>               - the next report is sent ms after the previous one instead of one period
+	sync                    - send a report with the current state
+   The script is replayed from the start when it ends */
+static int script_next(FILE *script, const layout *l, report *r, int64_t *gap)
+{
+	char line[128];
+	int  rewound = 0;
+	
+	while (1)
+	{
+		char command[16];
+		int  number;
+		int  value;
+		int  fields;
+		
+		if (!fgets(line, sizeof(line), script))
+		{
+			if (rewound)
+			{
+				return -1; /* Script without any sync */
+			}
+			
+			rewind(script);
+			rewound = 1;
+			continue;
+		}
+		
+		fields = sscanf(line, "%15s %d %d", command, &number, &value);
+		
+		if (fields < 1 || command[0] == '#')
+		{
+			continue;
+		}
+		
+		if (!strcmp(command, "sync"))
+		{
+			return 0;
+		}
+		else if (!strcmp(command, "wait") && fields >= 2 && number >= 0)
+		{
+			*gap = (int64_t)number * 1000000;
+		}
+		else if (!strcmp(command, "button") && fields == 3 && number >= 0 && (unsigned int)number < l->buttons)
+		{
+			r->buttons[number] = !!value;
+		}
+		else if (!strcmp(command, "axis") && fields == 3 && number >= 0 && (unsigned int)number < l->axes)
+		{
+			r->axes[number] = (value < AXIS_MIN) ? AXIS_MIN : ((value > AXIS_MAX) ? AXIS_MAX : value);
+		}
+		else
+		{
+			fprintf(stderr, "Ignoring script line: %s", line);
+		}
+	}
+}
+
+/* Records a real controller as a script
+	- Events sharing a timestamp are one report just as ps2bt groups them */
+static int record(const char *joystick_path, FILE *out)
+{
+	int             fd;
+	struct js_event event;
+	uint32_t        last_time = 0;
+	int             pending = 0;
+	int             first = 1;
+	
+	if ((fd = open(joystick_path, O_RDONLY)) == -1)
+	{
+		fprintf(stderr, "Error opening %s: %s\n", joystick_path, strerror(errno));
+		return -1;
+	}
+	
+	while (!quit && read(fd, &event, sizeof(event)) == sizeof(event))
+	{
+		if (pending && event.time != last_time)
+		{
+			fprintf(out, "sync\n");
+			pending = 0;
+		}
+		
+		if (!pending)
+		{
+			if (!first && !(event.type & JS_EVENT_INIT))
+			{
+				fprintf(out, "wait %u\n", (unsigned int)(event.time - last_time));
+			}
+			
+			first = 0;
+		}
+		
+		if ((event.type & ~JS_EVENT_INIT) == JS_EVENT_BUTTON)
+		{
+			fprintf(out, "button %u %d\n", event.number, event.value);
+		}
+		else if ((event.type & ~JS_EVENT_INIT) == JS_EVENT_AXIS)
+		{
+			fprintf(out, "axis %u %d\n", event.number, event.value);
+		}
+		
+		last_time = event.time;
+		pending = 1;
+	}
+	
+	if (pending)
+	{
+		fprintf(out, "sync\n");
+	}
+	
+	close(fd);
+	
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	printf("\nUsage: %s [options]\n\n", name);
+	printf("  -t <3|4>          Dualshock layout (default 3)\n");
+	printf("  -r <hz>           Report rate 1-%d (default 250)\n", MAX_RATE);
+	printf("  -p <profile>      idle, buttons, sticks, axes or all (default sticks)\n");
+	printf("  -s <file>         Replay a script instead of a profile\n");
+	printf("  -n <count>        Stop after count reports (default unlimited)\n");
+	printf("  -d <ms>           Delay before the first report (default 1000)\n");
+	printf("  -l <file>         Stamp reports and log \"sequence seconds stamp\" for each one\n");
+	printf("  -R <joystick>     Record a real controller to the script file given with -s\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	const layout    *l = &layouts[0];
+	long             rate = 250;
+	int              profile = 2;
+	const char      *script_path = NULL;
+	const char      *log_path = NULL;
+	const char      *record_path = NULL;
+	unsigned long    count = 0;
+	long             delay = 1000;
+	FILE            *script = NULL;
+	FILE            *log = NULL;
+	int              fd;
+	report           current;
+	report           previous;
+	uint32_t         sequence;
+	int64_t          period;
+	int64_t          next;
+	int64_t          late_max = 0;
+	unsigned long    late = 0;
+	struct sigaction action;
+	int              opt;
+	
+	while ((opt = getopt(argc, argv, "t:r:p:s:n:d:l:R:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': l = &layouts[atoi(optarg) == 4]; break;
+			case 'r': rate = atol(optarg); break;
+			case 's': script_path = optarg; break;
+			case 'n': count = strtoul(optarg, NULL, 10); break;
+			case 'd': delay = atol(optarg); break;
+			case 'l': log_path = optarg; break;
+			case 'R': record_path = optarg; break;
+			case 'p':
+			{
+				if ((profile = profile_lookup(optarg)) == -1)
+				{
+					fprintf(stderr, "Unknown profile %s\n", optarg);
+					exit(1);
+				}
+				
+				break;
+			}
+			default: usage(argv[0]); exit(0);
+		}
+	}
+	
+	if (rate < 1 || rate > MAX_RATE || delay < 0)
+	{
+		usage(argv[0]);
+		exit(1);
+	}
+	
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_signal;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	
+	if (record_path)
+	{
+		FILE *out;
+		int   result;
+		
+		if (!script_path || !(out = fopen(script_path, "w")))
+		{
+			fprintf(stderr, "Recording requires a writable script file (-s)\n");
+			exit(1);
+		}
+		
+		result = record(record_path, out);
+		fclose(out);
+		
+		exit(result == -1);
+	}
+	
+	if (script_path && !(script = fopen(script_path, "r")))
+	{
+		fprintf(stderr, "Error opening %s: %s\n", script_path, strerror(errno));
+		exit(1);
+	}
+	
+	if (log_path && !(log = fopen(log_path, "w")))
+	{
+		fprintf(stderr, "Error opening %s: %s\n", log_path, strerror(errno));
+		exit(1);
+	}
+	
+	if ((fd = uinput_create(l)) == -1)
+	{
+		exit(1);
+	}
+	
+	uinput_print_nodes(fd);
+	
+	memset(&current, 0, sizeof(current));
+	memcpy(current.axes, l->axis_rest, sizeof(current.axes));
+	previous = current;
+	
+	period = (int64_t)1000000000 / rate;
+	next = monotonic_time() + (int64_t)delay * 1000000;
+	
+	for (sequence = 0; !quit && (count == 0 || sequence < count); sequence++)
+	{
+		int64_t gap = period;
+		int64_t now;
+		
+		if (script)
+		{
+			if (script_next(script, l, &current, &gap) == -1)
+			{
+				fprintf(stderr, "Script %s has no sync command\n", script_path);
+				break;
+			}
+		}
+		else
+		{
+			profile_apply(profile, l, sequence, &current);
+		}
+		
+		if (log)
+		{
+			current.axes[STAMP_AXIS] = stamp_value(sequence);
+		}
+		
+		next += (sequence == 0) ? 0 : gap;
+		
+		sleep_until(next);
+		
+		now = monotonic_time();
+		
+		if (now - next > period)
+		{
+			late++;
+		}
+		
+		if (now - next > late_max)
+		{
+			late_max = now - next;
+		}
+		
+		if (uinput_send(fd, l, &current, &previous) == -1)
+		{
+			fprintf(stderr, "Error writing report: %s\n", strerror(errno));
+			break;
+		}
+		
+		if (log)
+		{
+			fprintf(log, "%lu %ld.%09ld %u\n", (unsigned long)sequence,
+			        (long)(now / 1000000000), (long)(now % 1000000000), (unsigned int)(sequence & 0xFF));
+		}
+	}
+	
+	fprintf(stderr, "%lu reports at %ldHz | %lu late by more than one period | max lateness %.3fms\n",
+	        (unsigned long)sequence, rate, late, (double)late_max / 1000000.0);
+	
+	ioctl(fd, UI_DEV_DESTROY);
+	close(fd);
+	
+	if (log)
+	{
+		fclose(log);
+	}
+	
+	if (script)
+	{
+		fclose(script);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Dualshock 3/4 Joystick Interface for Raspberry Pi
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Prints the Teensy's USB receive counters
+	- Usage: ps2bt-usbstat <serial device>
+	- Run after ps2bt has exited - the counters are kept until the Teensy is reset, so
+	  non-zero counts mean its receive ring (RX_BUFFER_SIZE in usb_serial.c) is too small
+	- Replies to packets still queued from ps2bt are skipped */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "serial.h"
+
+#define USBSTAT_TIMEOUT_MS 100
+#define USBSTAT_ATTEMPTS   10
+
+int main(int argc, char **argv)
+{
+	uint8_t      reply[RECV_PACKET_SIZE];
+	unsigned int i;
+	int          fd;
+	
+	if (argc != 2)
+	{
+		printf("\nUsage: %s <serial device>\n\n", argv[0]);
+		exit(0);
+	}
+	
+	if ((fd = serial_init(argv[1])) == -1)
+	{
+		exit(1);
+	}
+	
+	if (serial_send_diagnostics_packet(fd, 0) == -1)
+	{
+		fprintf(stderr, "Error writing to %s\n", argv[1]);
+		exit(1);
+	}
+	
+	for (i = 0; i < USBSTAT_ATTEMPTS; i++)
+	{
+		int received;
+		
+		if ((received = serial_recv_packet(fd, 0, &reply, USBSTAT_TIMEOUT_MS)) == -1)
+		{
+			fprintf(stderr, "Error reading from %s\n", argv[1]);
+			exit(1);
+		}
+		
+		if (received && reply[3] == SERIAL_DIAGNOSTICS_FOOTER)
+		{
+			printf("rx_overflows %u%s\n", (unsigned int)reply[1], (reply[1] == 0xFF) ? "+" : "");
+			printf("rx_naks      %u%s\n", (unsigned int)reply[2], (reply[2] == 0xFF) ? "+" : "");
+			exit(0);
+		}
+	}
+	
+	fprintf(stderr, "No diagnostics reply from %s - the firmware may predate them\n", argv[1]);
+	
+	exit(1);
+}
@@ -0,0 +1,205 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef HARDWARE_H
+#define HARDWARE_H
+
+/* Pins, timing and SPI signaling
+    - Only register names from <avr/io.h> are used so the protocol core can be built
+      on a host against the mocked registers in teensy/simulator */
+#include <avr/io.h> /* Device-specific I/O */
+
+/*******************************************************************************
+ Firmware Configuration
+*******************************************************************************/
+/*#define INVERT_SPI_MISO*/              /* Perform bitwise-not on SPI output */
+/*#define ACK_SIMULATED_OPEN_COLLECTOR*/ /* Use alternate Ack signaling */
+/*#define USE_8MHZ*/                     /* Run CPU at 8MHz instead of 16MHz */
+/*#define REPLY_ON_CHANGE_ONLY*/         /* Only reply to the Pi when motors or mode LED change */
+
+/* Tested as a condition so host builds can provide their own to switch it at run time */
+#ifndef REPLY_CHANGE_ONLY
+    #ifdef REPLY_ON_CHANGE_ONLY
+        #define REPLY_CHANGE_ONLY 1
+    #else
+        #define REPLY_CHANGE_ONLY 0
+    #endif
+#endif
+
+/*******************************************************************************
+ Hardware Configuration
+*******************************************************************************/
+/* CPU */
+#define CPU_PRESCALE(n)  (CLKPR = 0x80, CLKPR = (n))
+#define CPU_16MHz        0x00
+#define CPU_8MHz         0x01
+
+/* LED */
+extern unsigned char global_led_state; /* Reflects current LED state */
+
+#define LED_CONFIG()     ((DDRD  |=  (1<<6)), global_led_state = 0)
+#define LED_OFF()        ((PORTD &= ~(1<<6)), global_led_state = 0)
+#define LED_ON()         ((PORTD |=  (1<<6)), global_led_state = 1)
+#define LED_TOGGLE()     (global_led_state ? (LED_OFF()) : (LED_ON()))
+
+/* Timer - set timer1 prescaler to 1024 and start the timer */
+#define TIMER_CONFIG()   (TCCR1B |= (1 << CS12) | (1 << CS10)) 
+#define TIMER_READ()     ((unsigned int)(TCNT1))
+
+/* Attn */
+#define ATT_PIN          ((PINB & 1) == 1)
+
+/* Clk */
+#define CLK_PIN          ((PINB & 2)  > 0)
+
+/* Ack */
+#define ACK_INPUT()      (DDRB  &= ~(1<<7))
+#define ACK_OUTPUT()     (DDRB  |=  (1<<7))
+#define ACK_LOW()        (PORTB &= ~(1<<7))
+#define ACK_HIGH()       (PORTB |=  (1<<7))
+
+#ifdef ACK_SIMULATED_OPEN_COLLECTOR
+    #define ACK_CONFIG() ACK_INPUT(); ACK_LOW()
+#else
+    #define ACK_CONFIG() ACK_OUTPUT(); ACK_HIGH()
+#endif
+
+/* SPI */
+#define SPI_CONFIG()     (DDRB  |=  (1<<3))
+
+/* Attn pin change interrupt - PCINT0 is on the same pin as Attn */
+#define ATT_INTERRUPT_CONFIG() (PCMSK0 |= (1 << PCINT0), PCICR |= (1 << PCIE0))
+
+/*******************************************************************************
+ Timing
+*******************************************************************************/
+/* Timer constants
+    - Calculated based on 1024 prescale set by TIMER_CONFIG()
+*/
+#ifdef USE_8MHZ
+    #define TIMER_ONE_SECOND    7813
+    #define TIMER_TWO_SECONDS   15625
+    #define TIMER_THREE_SECONDS 23438
+    #define TIMER_REPLY_KEEPALIVE 1953
+#else
+    #define TIMER_ONE_SECOND    15625
+    #define TIMER_TWO_SECONDS   31250
+    #define TIMER_THREE_SECONDS 46875
+    #define TIMER_REPLY_KEEPALIVE 3906
+#endif
+
+/* Poll timestamps are reported to the Pi in units of 64us regardless of clock
+    - One timer tick is 64us @ 16MHz and 128us @ 8MHz */
+#ifdef USE_8MHZ
+    #define TIMER_TO_REPORT_UNITS(t) ((unsigned int)(t) << 1)
+#else
+    #define TIMER_TO_REPORT_UNITS(t) ((unsigned int)(t))
+#endif
+
+/* Delay macro functions
+    - Spam NOPs for high quality timing
+    - Each NOP is ~62.5 nanoseconds @ 16MHz */
+#ifndef HW_NOP /* Host builds provide their own to count cycles */
+    #define HW_NOP() __asm__("nop\n\t")
+#endif
+
+#define DELAY_8_CYCLES() \
+{                        \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+    HW_NOP();            \
+}
+
+#ifdef USE_8MHZ
+    #define DELAY_1_US()  \
+    {                     \
+        DELAY_8_CYCLES(); \
+    }
+#else
+    #define DELAY_1_US()  \
+    {                     \
+        DELAY_8_CYCLES(); \
+        DELAY_8_CYCLES(); \
+    }
+#endif
+
+#define DELAY_2_US() \
+{                    \
+    DELAY_1_US();    \
+    DELAY_1_US();    \
+}
+
+/* Below are not high accuracy */
+#define DELAY_1_MS()             \
+{                                \
+    int us;                      \
+    for (us = 0; us < 100; us++) \
+    {                            \
+        DELAY_2_US();            \
+        DELAY_2_US();            \
+        DELAY_2_US();            \
+        DELAY_2_US();            \
+        DELAY_2_US();            \
+    }                            \
+}
+
+#define DELAY_N_MS(n)            \
+{                                \
+    int ms;                      \
+    for (ms = 0; ms < (n); ms++) \
+    {                            \
+        DELAY_1_MS();            \
+    }                            \
+}
+
+/*******************************************************************************
+ SPI
+*******************************************************************************/
+/* SPI communication macro functions
+    - Transfers are driven by the SPI interrupt, one byte per interrupt
+    - The next byte out must be written before the console is acknowledged
+    - If at any point ATT_PIN goes high all transmissions reset
+    - ACK signal requires minimum 2us pulse */
+#ifdef ACK_SIMULATED_OPEN_COLLECTOR
+    #define SPI_ACK()                                     \
+    {                                                     \
+        ACK_OUTPUT();                                     \
+        DELAY_2_US();                                     \
+        ACK_INPUT();                                      \
+    }
+#else
+    #define SPI_ACK()                                     \
+    {                                                     \
+        ACK_LOW();                                        \
+        DELAY_2_US();                                     \
+        ACK_HIGH();                                       \
+    }
+#endif
+
+#ifdef INVERT_SPI_MISO
+    #define SPI_OUT_OPERATOR ~
+#else
+    #define SPI_OUT_OPERATOR
+#endif
+
+#define SPI_WRITE(out) (SPDR = (unsigned char)(SPI_OUT_OPERATOR(out)))
+
+#endif
@@ -0,0 +1,71 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "packet.h"
+
+void packet_parser_reset(packet_parser *parser)
+{
+    parser->length = 0;
+}
+
+/* Consume bytes until a packet is complete or the buffer is exhausted
+    - Returns a packet_result, *consumed is set to the number of bytes used
+    - Parsing stops after each complete packet so the caller can act on it
+      before passing the remainder of the buffer back in
+    - Bytes before a header and packets with an invalid footer are dropped */
+unsigned char packet_parse(packet_parser *parser, const unsigned char *buffer, unsigned char size,
+                           unsigned char *consumed)
+{
+    unsigned char i;
+    
+    for (i = 0; i < size; i++)
+    {
+        unsigned char byte = buffer[i];
+        
+        if (parser->length == 0)
+        {
+            /* Valid packets begin with the header of their slot */
+            if ((unsigned char)(byte - PACKET_HEADER) < PACKET_SLOTS)
+            {
+                parser->slot = byte - PACKET_HEADER;
+                parser->length = 1;
+            }
+        }
+        else if (parser->length <= PACKET_DATA_SIZE)
+        {
+            parser->data[parser->length++ - 1] = byte;
+        }
+        else
+        {
+            parser->length = 0;
+            
+            *consumed = i + 1;
+            
+            switch (byte)
+            {
+                case 0x55: return PACKET_UPDATE;
+                case 0xAA: return PACKET_MODE_BUTTON;
+                case 0x5A: return PACKET_DISCONNECT;
+                case PACKET_DIAGNOSTICS_FOOTER: return PACKET_DIAGNOSTICS;
+                default:   break; /* Invalid footer - drop the packet */
+            }
+        }
+    }
+    
+    *consumed = size;
+    
+    return PACKET_INCOMPLETE;
+}
@@ -0,0 +1,52 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PACKET_H
+#define PACKET_H
+
+/* USB packet framing
+    - Packets from the Pi are 20 bytes: header, 18 data bytes, footer
+    - The header is 0x5A plus the multitap slot the packet is for (0x5A to 0x5D)
+    - Valid packets end with 0x55, 0xAA (mode button pressed), 0x5A (disconnect)
+      or 0x3C (diagnostics request - the data bytes are ignored)
+    - This file has no hardware dependencies so it can be built on a host */
+#define PACKET_SIZE               20
+#define PACKET_DATA_SIZE          18
+#define PACKET_HEADER             0x5A /* Header of slot A */
+#define PACKET_SLOTS              4
+#define PACKET_DIAGNOSTICS_FOOTER 0x3C /* Footer of a diagnostics request and its response */
+
+enum packet_result
+{
+    PACKET_INCOMPLETE = 0, /* More bytes are needed */
+    PACKET_UPDATE,         /* Footer 0x55 - data holds a new controller state */
+    PACKET_MODE_BUTTON,    /* Footer 0xAA - as above and the mode button was pressed */
+    PACKET_DISCONNECT,     /* Footer 0x5A - the controller was disconnected */
+    PACKET_DIAGNOSTICS     /* Footer 0x3C - the Pi asks for the USB receive counters */
+};
+
+typedef struct
+{
+    unsigned char data[PACKET_DATA_SIZE]; /* Data bytes of the current packet */
+    unsigned char length;                 /* Bytes of the current packet received so far */
+    unsigned char slot;                   /* Multitap slot from the header of the current packet */
+} packet_parser;
+
+void          packet_parser_reset(packet_parser *parser);
+unsigned char packet_parse(packet_parser *parser, const unsigned char *buffer, unsigned char size,
+                           unsigned char *consumed);
+
+#endif
@@ -0,0 +1,730 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*******************************************************************************
+ Headers
+*******************************************************************************/
+#include <avr/io.h>        /* Device-specific I/O */
+#include <avr/interrupt.h> /* Enable/Disable interrupts */
+#include "hardware.h"      /* Pins, timing and SPI signaling */
+#include "ps2.h"           /* PS2 controller protocol core */
+
+unsigned char global_led_state;
+
+/*******************************************************************************
+ Controller
+*******************************************************************************/
+const unsigned char poll_idle[PACKET_DATA_SIZE] =
+{
+    0xFF, 0xFF,                                     /* No buttons pressed */
+    0x80, 0x80, 0x80, 0x80,                         /* Sticks centered */
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* No pressure */
+    0x00, 0x00, 0x00, 0x00
+};
+
+/* Build the poll responses for every mode into the back buffer */
+void build_poll_response(controller_state *pad, const unsigned char *data)
+{
+    unsigned char *back = pad->poll_response[pad->poll_front ^ 1];
+    unsigned char  i;
+    
+    back[POLL_DIGITAL + 0] = data[0] | BUTTON_L3 | BUTTON_R3; /* No sticks in digital mode */
+    back[POLL_DIGITAL + 1] = data[1];
+    
+    for (i = 0; i < PACKET_DATA_SIZE; i++)
+    {
+        back[POLL_ANALOG + i] = data[i];
+    }
+}
+
+controller_state controllers[MULTITAP_SLOTS];
+
+void reset_controller(controller_state *pad)
+{
+    build_poll_response(pad, poll_idle);
+    swap_poll_response(pad);
+    
+    pad->small_motor  = 0x00;
+    pad->large_motor  = 0x00;
+    
+    pad->config_mode  = 0x41;
+    pad->control_mode = 0x41;
+    
+    pad->mode_lock    = 0;
+    pad->mode_request = 0;
+    
+    pad->motor_map[0] = 0xFF;
+    pad->motor_map[1] = 0xFF;
+    pad->motor_map[2] = 0xFF;
+    pad->motor_map[3] = 0xFF;
+    pad->motor_map[4] = 0xFF;
+    pad->motor_map[5] = 0xFF;
+    
+    pad->response_mask[0] = 0xFF;
+    pad->response_mask[1] = 0xFF;
+    
+    pad->active = 0;
+}
+
+/* Non-zero while the multitap is presented - only read by the SPI interrupt and with the lock held */
+#define MULTITAP_PRESENT() (controllers[1].connected | controllers[2].connected | controllers[3].connected)
+
+/* Pad addressed by port byte 0x01 - slot A until the console selects another */
+static controller_state *multitap_pad = &controllers[0];
+
+void reset_multitap()
+{
+    multitap_pad = &controllers[0];
+}
+
+/* Must be called with the controller lock held
+    - The slot selection goes back to slot A with the multitap so the console
+      finds the plain controller it expects */
+void disconnect_controller(controller_state *pad)
+{
+    reset_controller(pad);
+    
+    pad->connected = 0;
+    
+    if (!MULTITAP_PRESENT())
+    {
+        reset_multitap();
+    }
+}
+
+/* Controller state is shared with the SPI interrupt
+    - Changes are made with interrupts disabled between transactions so the console
+      never sees a mix of old and new state within one transaction
+    - The console cannot get past the port byte without an ACK so a transaction
+      starting while the lock is held simply waits for it */
+void lock_controller()
+{
+    cli(); /* Disable interrupts */
+    
+    while (!ATT_PIN)
+    {
+        sei(); /* Enable interrupts */
+        DELAY_1_US();
+        cli(); /* Disable interrupts */
+    }
+}
+
+/*******************************************************************************
+ Transaction
+*******************************************************************************/
+/* State of the console transaction in progress
+    - Only touched by the SPI and Attn interrupts
+    - Response bytes for a command are chosen while the padding byte is transferred
+      so each data byte interrupt only has to write the next byte out */
+struct
+{
+    unsigned char        ignore;            /* Non-zero when the rest of the transaction is ignored */
+    unsigned char        index;             /* Number of bytes received in this transaction */
+    unsigned char        multitap;          /* Non-zero when the port byte addressed the multitap */
+    unsigned char        slot;              /* Slot of a multitap select - MULTITAP_SLOTS when out of range */
+    unsigned char        cmd;               /* Low nibble of the command byte - whole byte for the multitap */
+    controller_state    *pad;               /* Pad addressed by the transaction */
+    unsigned char        config;            /* Non-zero if the command arrived in config mode */
+    unsigned char        length;            /* Number of data bytes after the padding byte */
+    const unsigned char *response;          /* Data bytes sent to the console */
+    const unsigned char (*table)[4];        /* Rows selected by the first parameter - read constant commands */
+    unsigned char        scratch[6];        /* Storage for data bytes which are computed */
+    unsigned char        param[6];          /* Data bytes received from the console */
+    unsigned int         timestamp;         /* Timer value when the port byte arrived */
+} transaction;
+
+volatile unsigned char console_activity;
+
+/* Constant responses */
+const unsigned char response_zero[6]                   = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+const unsigned char response_init_pressure[6]          = { 0x00, 0x00, 0x02, 0x00, 0x00, 0x5A };
+const unsigned char response_set_poll_result_format[6] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x5A };
+
+const unsigned char response_available_poll_results[2][4] =
+{
+    { 0x00, 0x00, 0x00, 0x00 },
+    { 0x03, 0x00, 0x00, 0x5A }
+};
+
+/* Multitap responses
+    - The byte sent for the padding byte is 0x5A for a query and 0x00 for a select */
+const unsigned char response_multitap_pads[3] = { 0x04, 0x00, 0x5A };
+
+const unsigned char response_multitap_select[MULTITAP_SLOTS + 1][4] =
+{
+    { 0x00, 0x00, 0x00, 0x5A },
+    { 0x00, 0x00, 0x01, 0x5A },
+    { 0x00, 0x00, 0x02, 0x5A },
+    { 0x00, 0x00, 0x03, 0x5A },
+    { 0x00, 0x00, 0xFF, 0x66 }  /* Slot out of range */
+};
+
+const unsigned char response_read_const_offset[16] =
+{
+    0, 0, 0, 0, 0, 0, 0, 1,
+    0, 0, 0, 0, 2, 0, 0, 0
+};
+
+const unsigned char response_read_const[3][2][4] =
+{
+    {
+        { 0x01, 0x02, 0x00, 0x0A },
+        { 0x01, 0x01, 0x01, 0x14 }
+    },
+    {
+        { 0x02, 0x00, 0x01, 0x00 },
+        { 0x02, 0x00, 0x01, 0x00 }
+    },
+    {
+        { 0x00, 0x04, 0x00, 0x00 },
+        { 0x00, 0x07, 0x00, 0x00 }
+    }
+};
+
+/* Choose the data bytes sent for a command
+    - Commands without data bytes are unsupported and end after the padding byte */
+static inline void prepare_response(unsigned char cmd)
+{
+    controller_state *pad = transaction.pad;
+    
+    transaction.response = transaction.scratch;
+    transaction.length = 6;
+    
+    switch (cmd)
+    {
+        /* 0x40 */
+        case cmd_init_pressure:
+        {
+            transaction.response = response_init_pressure;
+            
+            return;
+        }
+        
+        /* 0x41 */
+        case cmd_get_available_poll_results:
+        {
+            unsigned char mode = (pad->config_mode & 0x10) >> 4;
+            unsigned char mask = ~mode + 1;
+            
+            transaction.scratch[0] = pad->response_mask[0] & mask;
+            transaction.scratch[1] = pad->response_mask[1] & mask;
+            transaction.scratch[2] = response_available_poll_results[mode][0];
+            transaction.scratch[3] = response_available_poll_results[mode][1];
+            transaction.scratch[4] = response_available_poll_results[mode][2];
+            transaction.scratch[5] = response_available_poll_results[mode][3];
+            
+            return;
+        }
+        
+        /* 0x43 */
+        case cmd_escape:
+        {
+            if (transaction.config) /* If in config mode */
+            {
+                transaction.response = response_zero;
+                
+                return;
+            }
+            
+            /* If not in config mode then 0x43 is substantially 0x42 */
+        }
+        
+        /* 0x42 */
+        case cmd_poll:
+        {
+            const unsigned char *poll = pad->poll_response[pad->poll_front]; /* Latched for the whole transaction */
+            
+            switch (pad->control_mode)
+            {
+                case 0x41: /* digital mode */
+                {
+                    transaction.response = &poll[POLL_DIGITAL];
+                    transaction.length = 2;
+                    
+                    return;
+                }
+                case 0xF3: /* config mode */
+                case 0x73: /* digital buttons, analog joysticks */
+                {
+                    transaction.response = &poll[POLL_ANALOG];
+                    
+                    return;
+                }
+                case 0x79: /* analog joysticks, analog buttons */
+                {
+                    transaction.response = &poll[POLL_ANALOG];
+                    transaction.length = 18;
+                    
+                    return;
+                }
+            }
+            
+            transaction.length = 0;
+            
+            return;
+        }
+        
+        /* 0x44 */
+        case cmd_set_major_mode:
+        {
+            transaction.response = response_zero;
+            
+            return;
+        }
+        
+        /* 0x45 */
+        case cmd_read_ext_status:
+        {
+            transaction.scratch[0] = 0x03; /* This is 0x01 for DS1 and GH guitar */
+            transaction.scratch[1] = 0x02;
+            transaction.scratch[2] = (pad->config_mode & 0x10) >> 4;
+            transaction.scratch[3] = 0x02;
+            transaction.scratch[4] = 0x01;
+            transaction.scratch[5] = 0x00;
+            
+            return;
+        }
+        
+        /* 0x46 */
+        /* 0x47 */
+        /* 0x4C */
+        case cmd_read_const_1:
+        case cmd_read_const_2:
+        case cmd_read_const_3:
+        {
+            /* The last four bytes are filled in when the parameter arrives */
+            transaction.table = response_read_const[response_read_const_offset[cmd]];
+            transaction.scratch[0] = 0x00;
+            transaction.scratch[1] = 0x00;
+            
+            return;
+        }
+        
+        /* 0x4D */
+        case cmd_set_poll_cmd_format:
+        {
+            transaction.scratch[0] = pad->motor_map[0];
+            transaction.scratch[1] = pad->motor_map[1];
+            transaction.scratch[2] = pad->motor_map[2];
+            transaction.scratch[3] = pad->motor_map[3];
+            transaction.scratch[4] = pad->motor_map[4];
+            transaction.scratch[5] = pad->motor_map[5];
+            
+            return;
+        }
+        
+        /* 0x4F */
+        case cmd_set_poll_result_format:
+        {
+            transaction.response = response_set_poll_result_format;
+            
+            return;
+        }
+        
+        default:
+        {
+            transaction.length = 0;
+            
+            return;
+        }
+    }
+}
+
+/* Apply the effects of a command once its last byte has been transferred */
+static inline void finish_command()
+{
+    controller_state *pad = transaction.pad;
+    
+    switch (transaction.cmd)
+    {
+        /* 0x43 */
+        case cmd_escape:
+        {
+            if (transaction.config) /* If in config mode */
+            {
+                if ((transaction.param[0] & 0x01) == 0) /* If the parameter is zero then exit config mode */
+                {
+                    pad->control_mode = pad->config_mode;
+                    
+                    /* If the mode button was pressed and its action deferred
+                       and the mode is not locked
+                       and the mode has not changed since the mode button was pressed
+                       then toggle the mode
+                       
+                       Note: The mode button's deferred action logic might not be neccessary 
+                             but it might resolve potential behavioral inconsistencies
+                    */
+                    if (pad->mode_request
+                    && !pad->mode_lock
+                    &&  pad->mode_request == pad->control_mode)
+                    {
+                        pad->control_mode = (pad->control_mode == 0x41) ? 0x73 : 0x41;
+                        
+                        pad->mode_request = 0; /* Request has been handled */
+                    }
+                }
+            }
+            else if ((transaction.param[0] & 0x01) == 0x01) /* Enter configuration mode */
+            {
+                pad->config_mode = pad->control_mode;
+                pad->control_mode = 0xF3;
+            }
+            
+            return;
+        }
+        
+        /* 0x42 */
+        case cmd_poll: /* Update motor states */
+        {
+            unsigned char i;
+            
+            pad->poll_timestamp = transaction.timestamp; /* Record when this poll began */
+            
+            for (i = 0; i < 6; i++)
+            {
+                if (pad->motor_map[i] == 0x00)
+                {
+                    pad->small_motor = transaction.param[i];
+                }
+                else if (pad->motor_map[i] == 0x01)
+                {
+                    pad->large_motor = transaction.param[i];
+                }
+            }
+            
+            return;
+        }
+        
+        /* 0x44 */
+        case cmd_set_major_mode:
+        {
+            pad->mode_lock = (transaction.param[1] == 0x03); /* Only 0x03 locks the mode */
+            
+            pad->config_mode = ((transaction.param[0] & 0x01) == 0x00) ? 0x41 : 0x73;
+            
+            return;
+        }
+        
+        /* 0x4D */
+        case cmd_set_poll_cmd_format:
+        {
+            pad->motor_map[0] = transaction.param[0];
+            pad->motor_map[1] = transaction.param[1];
+            pad->motor_map[2] = transaction.param[2];
+            pad->motor_map[3] = transaction.param[3];
+            pad->motor_map[4] = transaction.param[4];
+            pad->motor_map[5] = transaction.param[5];
+            
+            return;
+        }
+        
+        /* Multitap 0x21 */
+        case multitap_select_pad:
+        {
+            if (transaction.slot < MULTITAP_SLOTS)
+            {
+                multitap_pad = &controllers[transaction.slot];
+            }
+            
+            return;
+        }
+        
+        /* 0x4F */
+        case cmd_set_poll_result_format:
+        {
+            pad->response_mask[0] = transaction.param[0];
+            pad->response_mask[1] = transaction.param[1];
+            
+            if (pad->config_mode == 0x73)
+            {
+                pad->config_mode = 0x79;
+            }
+            
+            return;
+        }
+    }
+}
+
+/* Ignore any transaction in progress until Attn goes high */
+void ignore_transaction()
+{
+    transaction.ignore = 1;
+    
+    SPI_WRITE(0xFF);
+}
+
+/*******************************************************************************
+ Interrupts
+*******************************************************************************/
+/* Attn changed
+    - Falling edge: LED reflects attention line activity
+    - Rising edge: the SPI hardware has reset so the next byte begins a new transaction */
+ISR(PCINT0_vect)
+{
+    if (ATT_PIN)
+    {
+        transaction.ignore = 0;
+        transaction.index = 0;
+        
+        SPI_WRITE(0xFF);
+    }
+    else
+    {
+        LED_ON();
+    }
+}
+
+/* SPI byte transferred
+    - The byte out for the next transfer is written before the console is acknowledged
+    - Ignored transactions get 0xFF and no ACK until Attn goes high */
+ISR(SPI_STC_vect)
+{
+    unsigned char in = SPDR;
+    unsigned char index;
+    
+    if (transaction.ignore)
+    {
+        SPI_WRITE(0xFF);
+        
+        return;
+    }
+    
+    index = transaction.index++;
+    
+    /* Data bytes come first as they are the most frequent */
+    if (index >= 3)
+    {
+        index -= 3;
+        
+        if (index < sizeof(transaction.param))
+        {
+            transaction.param[index] = in;
+        }
+        
+        /* Read constant commands answer from the row selected by the first parameter */
+        if (index == 0 && transaction.table)
+        {
+            const unsigned char *row = transaction.table[in & 0x01];
+            
+            transaction.scratch[2] = row[0];
+            transaction.scratch[3] = row[1];
+            transaction.scratch[4] = row[2];
+            transaction.scratch[5] = row[3];
+        }
+        
+        if (++index < transaction.length)
+        {
+            SPI_WRITE(transaction.response[index]);
+            SPI_ACK();
+        }
+        else /* Last byte - no ACK */
+        {
+            transaction.ignore = 1;
+            
+            SPI_WRITE(0xFF);
+            
+            finish_command();
+        }
+        
+        return;
+    }
+    
+    switch (index)
+    {
+        /* First byte is port number
+            - 0x01 addresses the pad in the selected slot - ignored if not connected
+            - 0x21 addresses the multitap - ignored while it is not presented
+            - Ignore packets for anything else */
+        case 0:
+        {
+            controller_state *pad = multitap_pad;
+            
+            if (in == 0x01 && pad->connected)
+            {
+                SPI_WRITE(pad->control_mode);
+                SPI_ACK();
+                
+                transaction.timestamp = TIMER_READ();
+                transaction.pad = pad;
+                transaction.multitap = 0;
+                
+                pad->active = 1; /* Controller is active */
+                
+                console_activity = 1; /* Reset idle timer */
+                
+                return;
+            }
+            
+            if (in == 0x21 && MULTITAP_PRESENT())
+            {
+                SPI_WRITE(0x80);
+                SPI_ACK();
+                
+                transaction.multitap = 1;
+                
+                console_activity = 1; /* Reset idle timer */
+                
+                return;
+            }
+            
+            transaction.ignore = 1;
+            
+            SPI_WRITE(0xFF);
+            
+            return;
+        }
+        
+        /* Second byte is command
+            - Valid commands begin with 0x4 as the high nibble
+            - Only 0x42 (poll) and 0x43 (enter or exit config mode) are valid in normal mode
+            - The multitap only answers its pad commands
+            - The response is prepared while the padding byte is transferred */
+        case 1:
+        {
+            unsigned char cmd = in & 0x0F; /* Only the low nibble of the command is used */
+            
+            if (transaction.multitap)
+            {
+                if (in == multitap_query_pads)
+                {
+                    SPI_WRITE(0x5A);
+                    
+                    transaction.response = response_multitap_pads;
+                    transaction.length = sizeof(response_multitap_pads);
+                }
+                else if (in == multitap_select_pad)
+                {
+                    SPI_WRITE(0x00);
+                    
+                    transaction.response = response_multitap_select[MULTITAP_SLOTS];
+                    transaction.length = sizeof(response_multitap_select[0]);
+                    transaction.slot = MULTITAP_SLOTS;
+                }
+                else
+                {
+                    transaction.ignore = 1;
+                    
+                    SPI_WRITE(0xFF);
+                    
+                    return;
+                }
+                
+                SPI_ACK();
+                
+                transaction.cmd = in;
+                transaction.table = 0;
+                
+                return;
+            }
+            
+            if ((in & 0xF0) != 0x40
+            || (transaction.pad->control_mode != 0xF3 && cmd != cmd_poll && cmd != cmd_escape))
+            {
+                transaction.ignore = 1;
+                
+                SPI_WRITE(0xFF);
+                
+                return;
+            }
+            
+            SPI_WRITE(0x5A);
+            SPI_ACK();
+            
+            transaction.cmd = cmd;
+            transaction.config = (transaction.pad->control_mode == 0xF3);
+            transaction.table = 0;
+            
+            transaction.param[0] = 0x00;
+            transaction.param[1] = 0x00;
+            transaction.param[2] = 0x00;
+            transaction.param[3] = 0x00;
+            transaction.param[4] = 0x00;
+            transaction.param[5] = 0x00;
+            
+            prepare_response(cmd);
+            
+            return;
+        }
+        
+        /* Third byte is padding - or the slot of a multitap select */
+        default:
+        {
+            if (transaction.length == 0) /* Unsupported command */
+            {
+                transaction.ignore = 1;
+                
+                SPI_WRITE(0xFF);
+                
+                return;
+            }
+            
+            if (transaction.multitap && transaction.cmd == multitap_select_pad && in < MULTITAP_SLOTS)
+            {
+                transaction.response = response_multitap_select[in];
+                transaction.slot = in;
+            }
+            
+            SPI_WRITE(transaction.response[0]);
+            SPI_ACK();
+            
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+ Packet
+*******************************************************************************/
+/* Apply a complete packet from the Pi
+    - The caller holds the controller lock and unless the packet is a disconnect
+      has already built the poll responses from its data into the back buffer
+    - Returns the footer of the response - 0x55 for mode LED off - 0xAA for mode LED on */
+unsigned char apply_packet(controller_state *pad, unsigned char result)
+{
+    if (result == PACKET_DISCONNECT) /* Packets ending with 0x5A disconnect the controller */
+    {
+        disconnect_controller(pad);
+        
+        return 0x55;
+    }
+    
+    swap_poll_response(pad);
+    
+    /* If the mode button was pressed and the mode is not locked */
+    if (result == PACKET_MODE_BUTTON && !pad->mode_lock)
+    {
+        /* Defer mode button action if currently in config mode */
+        if (pad->control_mode == 0xF3)
+        {
+            pad->mode_request = pad->config_mode;
+        }
+        /* Otherwise toggle the mode */
+        else
+        {
+            pad->control_mode = (pad->control_mode == 0x41) ? 0x73 : 0x41;
+        }
+    }
+    
+    pad->connected = 1;
+    
+    if (pad->control_mode == 0x41
+    || (pad->control_mode == 0xF3 && pad->config_mode == 0x41))
+    {
+        return 0x55;
+    }
+    
+    return 0xAA;
+}
@@ -0,0 +1,142 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef PS2_H
+#define PS2_H
+
+/* PS2 controller protocol core
+    - Serves the console from the SPI and Attn interrupts
+    - Holds the controller state applied from USB packets
+    - Uses only the macros in hardware.h so it builds on a host for teensy/simulator */
+#include <avr/interrupt.h> /* Enable/Disable interrupts */
+#include "packet.h"        /* USB packet framing */
+
+enum button_bitmasks /* Button bits are zero when pressed */
+{
+    /* buttons[0] */
+    BUTTON_SELECT     = 0x01,
+    BUTTON_L3         = 0x02,
+    BUTTON_R3         = 0x04,
+    BUTTON_START      = 0x08,
+    BUTTON_UP         = 0x10,
+    BUTTON_RIGHT      = 0x20,
+    BUTTON_DOWN       = 0x40,
+    BUTTON_LEFT       = 0x80,
+    
+    /* buttons[1] */
+    BUTTON_L2         = 0x01,
+    BUTTON_R2         = 0x02,
+    BUTTON_L1         = 0x04,
+    BUTTON_R1         = 0x08,
+    BUTTON_TRIANGLE   = 0x10,
+    BUTTON_CIRCLE     = 0x20,
+    BUTTON_CROSS      = 0x40,
+    BUTTON_SQUARE     = 0x80,
+};
+
+enum commands
+{
+    cmd_init_pressure              = 0x00,
+    cmd_get_available_poll_results = 0x01,
+    cmd_poll                       = 0x02,
+    cmd_escape                     = 0x03,
+    cmd_set_major_mode             = 0x04,
+    cmd_read_ext_status            = 0x05,
+    cmd_read_const_1               = 0x06,
+    cmd_read_const_2               = 0x07,
+    cmd_unsupported_8h             = 0x08,
+    cmd_unsupported_9h             = 0x09,
+    cmd_unsupported_ah             = 0x0A,
+    cmd_unsupported_bh             = 0x0B,
+    cmd_read_const_3               = 0x0C,
+    cmd_set_poll_cmd_format        = 0x0D,
+    cmd_unsupported_eh             = 0x0E,
+    cmd_set_poll_result_format     = 0x0F,
+};
+
+enum multitap_commands
+{
+    multitap_query_pads = 0x12, /* Number of pad slots */
+    multitap_select_pad = 0x21, /* Slot addressed by the next pad transactions */
+};
+
+/* Poll responses
+    - Built for every mode whenever new state arrives so a poll only streams bytes
+    - Analog data is in console order: buttons[2], rx, ry, lx, ly, then pressures for
+      right, left, up, down, triangle, circle, cross, square, l1, r1, l2, r2
+    - Digital mode (0x41) sends POLL_DIGITAL with L3 and R3 forced released
+    - Analog modes send the first 6 (0x73, 0xF3) or all 18 (0x79) bytes of POLL_ANALOG
+    - Double-buffered: the SPI interrupt streams the front buffer while the other buffer
+      is rebuilt, then the buffers are swapped between transactions
+    - Every multitap slot has its own pair so polling any pad is the same byte stream */
+#define POLL_DIGITAL       0
+#define POLL_ANALOG        2
+#define POLL_RESPONSE_SIZE (POLL_ANALOG + PACKET_DATA_SIZE)
+
+/* Multitap
+    - Slots B to D are presented through a multitap (port byte 0x21) while one of them
+      is connected, so with a single pad the console sees a plain controller
+    - The console selects a slot with multitap command 0x21 and then addresses the pad
+      in that slot with port byte 0x01 as usual
+    - Only pad slots are emulated, memory card commands (0x13, 0x22) are not answered
+      so the console's own memory card is used directly */
+#define MULTITAP_SLOTS PACKET_SLOTS
+
+typedef struct
+{
+    /* Poll responses */
+    unsigned char poll_response[2][POLL_RESPONSE_SIZE];
+    unsigned char poll_front;       /* Index of the buffer streamed to the console */
+    
+    /* Motor states */
+    unsigned char small_motor;
+    unsigned char large_motor;
+    
+    /* Internal controller state */
+    unsigned char active;           /* Non-zero when console activity has been observed since last reset */
+    unsigned char control_mode;     /* Current mode of the controller */
+    unsigned char config_mode;      /* Current mode of the controller when control_mode is 0xF3: config mode */
+    unsigned char mode_lock;        /* Non-zero if the mode button has no effect when pressed (locked) */
+    unsigned char mode_request;     /* When the mode button is pressed and the controller is in config mode the
+                                       mode change is deferred until exiting config mode by setting this
+                                       to the current mode number (it will otherwise be zero) */
+    unsigned char motor_map[6];     /* Current mapping of the controller's motors */
+    unsigned char response_mask[2]; /* 16 bits set by command 0x4F and read by 0x41, may exist to mask controller data
+                                       but no examples of this appear to exist so emulation is limited to read/write */
+    unsigned char connected;        /* Non-zero when controller is connected - not effected by reset_controller() */
+    unsigned int  poll_timestamp;   /* Timer value at the start of the last 0x42 poll - not effected by
+                                       reset_controller() */
+} controller_state;
+
+/* Make the back buffer the one streamed to the console
+    - Must only be called between transactions */
+#define swap_poll_response(pad) ((pad)->poll_front ^= 1)
+
+extern controller_state controllers[MULTITAP_SLOTS];
+
+extern volatile unsigned char console_activity; /* Set by the SPI interrupt - cleared by the idle tasks */
+
+void          build_poll_response(controller_state *pad, const unsigned char *data);
+void          reset_controller(controller_state *pad);
+void          disconnect_controller(controller_state *pad);
+void          reset_multitap();
+void          lock_controller();
+unsigned char apply_packet(controller_state *pad, unsigned char result);
+void          ignore_transaction();
+
+#define unlock_controller() sei()
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*******************************************************************************
+ Headers
+*******************************************************************************/
+#include <avr/io.h>        /* Device-specific I/O */
+#include <avr/interrupt.h> /* Enable/Disable interrupts */
+#include "usb_serial.h"    /* USB serial support */
+#include "hardware.h"      /* Pins, timing and SPI signaling */
+#include "ps2.h"           /* PS2 controller protocol core */
+#include "reply.h"         /* Responses to the Pi */
+
+/*******************************************************************************
+ USB Response
+*******************************************************************************/
+/* Response packet layout
+    - Byte 0:   Header 0x5A plus the multitap slot of the packet being answered
+    - Byte 1:   Small motor
+    - Byte 2:   Large motor
+    - Byte 3:   Footer - 0x55 for mode LED off - 0xAA for mode LED on
+    - Byte 4-5: Timestamp of the last console poll (little-endian, 64us units)
+    - Byte 6-7: Time elapsed since that poll when this response was composed
+   
+   The response is written in one call and flushed so it goes out in a single USB transfer */
+static void write_response(unsigned char slot, unsigned char small_motor, unsigned char large_motor,
+                           unsigned char footer, unsigned int poll_timestamp, unsigned int now)
+{
+    unsigned char response[8];
+    unsigned int  timestamp = TIMER_TO_REPORT_UNITS(poll_timestamp);
+    unsigned int  age = TIMER_TO_REPORT_UNITS(now - poll_timestamp);
+    
+    response[0] = PACKET_HEADER + slot; /* Header */
+    
+    response[1] = small_motor; /* Motors */
+    response[2] = large_motor;
+    
+    response[3] = footer; /* Footer */
+    
+    response[4] = timestamp & 0xFF; /* Poll timing */
+    response[5] = timestamp >> 8;
+    response[6] = age & 0xFF;
+    response[7] = age >> 8;
+    
+    usb_serial_write(response, sizeof(response));
+    usb_serial_flush_output();
+}
+
+/* With REPLY_ON_CHANGE_ONLY the Pi, started with -c, treats a missing response as unchanged
+   motors and mode LED
+    - A response is still sent every TIMER_REPLY_KEEPALIVE so the Pi keeps receiving poll timing */
+static void send_response(unsigned char slot, unsigned char small_motor, unsigned char large_motor,
+                          unsigned char footer, unsigned int poll_timestamp)
+{
+    unsigned int now = TIMER_READ();
+    
+    if (REPLY_CHANGE_ONLY)
+    {
+        static unsigned char sent[PACKET_SLOTS];
+        static unsigned char sent_small_motor[PACKET_SLOTS];
+        static unsigned char sent_large_motor[PACKET_SLOTS];
+        static unsigned char sent_footer[PACKET_SLOTS];
+        static unsigned int  sent_timer[PACKET_SLOTS];
+        
+        if (sent[slot]
+        &&  small_motor == sent_small_motor[slot]
+        &&  large_motor == sent_large_motor[slot]
+        &&  footer      == sent_footer[slot]
+        && (now - sent_timer[slot]) < TIMER_REPLY_KEEPALIVE)
+        {
+            return;
+        }
+        
+        sent[slot] = 1;
+        sent_small_motor[slot] = small_motor;
+        sent_large_motor[slot] = large_motor;
+        sent_footer[slot] = footer;
+        sent_timer[slot] = now;
+    }
+    
+    write_response(slot, small_motor, large_motor, footer, poll_timestamp, now);
+}
+
+/* Diagnostics response
+    - Laid out as a response with the motor bytes replaced by the USB receive counters,
+      each capped at 0xFF, and the footer PACKET_DIAGNOSTICS_FOOTER
+    - Always sent, even with REPLY_ON_CHANGE_ONLY, and leaves the controller untouched
+    - Byte 1: Times the receive ring filled while the endpoint still held data
+    - Byte 2: Times the host was NAKed as a result */
+void send_diagnostics(unsigned char slot)
+{
+    unsigned int overflows = usb_serial_rx_overflows();
+    unsigned int naks = usb_serial_rx_naks();
+    unsigned int poll_timestamp;
+    
+    lock_controller();
+    poll_timestamp = controllers[slot].poll_timestamp;
+    unlock_controller();
+    
+    write_response(slot, (overflows > 0xFF) ? 0xFF : overflows, (naks > 0xFF) ? 0xFF : naks,
+                   PACKET_DIAGNOSTICS_FOOTER, poll_timestamp, TIMER_READ());
+}
+
+/*******************************************************************************
+ USB Packet
+*******************************************************************************/
+/* Apply a complete packet from the Pi
+    - Data bytes are in the order they are sent to the console
+    - The response is sent after the controller is unlocked */
+void handle_packet(unsigned char result, unsigned char slot, const unsigned char *data)
+{
+    controller_state *pad = &controllers[slot];
+    unsigned char     small_motor;
+    unsigned char     large_motor;
+    unsigned char     footer;
+    unsigned int      poll_timestamp;
+    
+    /* The back buffer is never streamed so it is built before taking the lock */
+    if (result != PACKET_DISCONNECT)
+    {
+        build_poll_response(pad, data);
+    }
+    
+    lock_controller();
+    
+    footer = apply_packet(pad, result);
+    
+    small_motor = pad->small_motor;
+    large_motor = pad->large_motor;
+    poll_timestamp = pad->poll_timestamp;
+    
+    unlock_controller();
+    
+    send_response(slot, small_motor, large_motor, footer, poll_timestamp);
+}
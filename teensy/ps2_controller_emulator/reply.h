@@ -0,0 +1,29 @@
+/*
+ * PS2 Controller Emulator v2.0 for Teensy 2.0
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef REPLY_H
+#define REPLY_H
+
+/* Responses to packets from the Pi
+    - Applies each packet to the protocol core and writes the response over USB serial
+    - Only the usb_serial.h calls and the macros in hardware.h are used so teensy/simulator
+      runs this same reply path against its own USB serial stand-in */
+#include "packet.h" /* USB packet framing */
+
+void handle_packet(unsigned char result, unsigned char slot, const unsigned char *data);
+void send_diagnostics(unsigned char slot);
+
+#endif
@@ -305,6 +305,18 @@ static uint8_t transmit_previous_timeout=0;
 static uint8_t cdc_line_coding[7]={0x00, 0xE1, 0x00, 0x00, 0x00, 0x00, 0x08};
 static uint8_t cdc_line_rtsdtr=0;
 
+// receive ring buffer, filled by the endpoint interrupt as soon as the
+// host sends data so it never waits on the main program.  When the ring
+// is full the data stays in the endpoint (the host is NAKed) and the
+// interrupt is disabled until the main program has made room.
+#define RX_BUFFER_SIZE		64	// must be a power of two
+#define RX_BUFFER_MASK		(RX_BUFFER_SIZE - 1)
+static volatile uint8_t rx_buffer[RX_BUFFER_SIZE];
+static volatile uint8_t rx_head=0;
+static volatile uint8_t rx_tail=0;
+static volatile uint16_t rx_overflow_count=0;
+static volatile uint16_t rx_nak_count=0;
+
 
 /**************************************************************************
  *
@@ -337,52 +349,43 @@ uint8_t usb_configured(void)
 // get the next character, or -1 if nothing received
 int16_t usb_serial_getchar(void)
 {
-	uint8_t c, intr_state;
+	uint8_t c;
+
+	if (!usb_serial_read(&c, 1)) return -1;
+	return c;
+}
+
+// receive up to size bytes, returns the number of bytes received.
+// Bytes come from the receive ring buffer, and if the ring had filled
+// the endpoint interrupt is enabled again to move the rest in.
+uint8_t usb_serial_read(uint8_t *buffer, uint8_t size)
+{
+	uint8_t tail, count=0, intr_state;
 
-	// interrupts are disabled so these functions can be
-	// used from the main program or interrupt context,
-	// even both in the same program!
 	intr_state = SREG;
 	cli();
-	if (!usb_configuration) {
-		SREG = intr_state;
-		return -1;
+	tail = rx_tail;
+	while (count < size && tail != rx_head) {
+		buffer[count++] = rx_buffer[tail];
+		tail = (tail + 1) & RX_BUFFER_MASK;
 	}
-	UENUM = CDC_RX_ENDPOINT;
-	retry:
-	c = UEINTX;
-	if (!(c & (1<<RWAL))) {
-		// no data in buffer
-		if (c & (1<<RXOUTI)) {
-			UEINTX = 0x6B;
-			goto retry;
-		}	
-		SREG = intr_state;
-		return -1;
+	rx_tail = tail;
+	if (count && usb_configuration) {
+		UENUM = CDC_RX_ENDPOINT;
+		UEIENX = (1<<RXOUTE);
 	}
-	// take one byte out of the buffer
-	c = UEDATX;
-	// if buffer completely used, release it
-	if (!(UEINTX & (1<<RWAL))) UEINTX = 0x6B;
 	SREG = intr_state;
-	return c;
+	return count;
 }
 
 // number of bytes available in the receive buffer
 uint8_t usb_serial_available(void)
 {
-	uint8_t n=0, i, intr_state;
+	uint8_t n, intr_state;
 
 	intr_state = SREG;
 	cli();
-	if (usb_configuration) {
-		UENUM = CDC_RX_ENDPOINT;
-		n = UEBCLX;
-		if (!n) {
-			i = UEINTX;
-			if (i & (1<<RXOUTI) && !(i & (1<<RWAL))) UEINTX = 0x6B;
-		}
-	}
+	n = (rx_head - rx_tail) & RX_BUFFER_MASK;
 	SREG = intr_state;
 	return n;
 }
@@ -392,15 +395,44 @@ void usb_serial_flush_input(void)
 {
 	uint8_t intr_state;
 
+	intr_state = SREG;
+	cli();
+	rx_tail = rx_head;
 	if (usb_configuration) {
-		intr_state = SREG;
-		cli();
 		UENUM = CDC_RX_ENDPOINT;
 		while ((UEINTX & (1<<RWAL))) {
 			UEINTX = 0x6B; 
 		}
-		SREG = intr_state;
+		UEIENX = (1<<RXOUTE);
 	}
+	SREG = intr_state;
+}
+
+// number of times the receive ring filled while the endpoint still
+// held data, and number of times the host was NAKed as a result.
+// Both are for sizing RX_BUFFER_SIZE and are reported to the Pi
+// by the diagnostics response in emulator.c.
+uint16_t usb_serial_rx_overflows(void)
+{
+	uint16_t n;
+	uint8_t intr_state;
+
+	intr_state = SREG;
+	cli();
+	n = rx_overflow_count;
+	SREG = intr_state;
+	return n;
+}
+uint16_t usb_serial_rx_naks(void)
+{
+	uint16_t n;
+	uint8_t intr_state;
+
+	intr_state = SREG;
+	cli();
+	n = rx_nak_count;
+	SREG = intr_state;
+	return n;
 }
 
 // transmit a character.  0 returned on success, -1 on error
@@ -768,9 +800,48 @@ static inline void usb_ack_out(void)
 
 
 
-// USB Endpoint Interrupt - endpoint 0 is handled here.  The
-// other endpoints are manipulated by the user-callable
-// functions, and the start-of-frame interrupt.
+// Receive endpoint - move everything waiting in the endpoint into
+// the receive ring buffer.  NAKOUTI must be read before the bank is
+// released since releasing it (0x6B) also clears NAKOUTI.
+static inline void usb_serial_rx_endpoint(void)
+{
+	uint8_t c, n, head, space;
+
+	UENUM = CDC_RX_ENDPOINT;
+	if (UEINTX & (1<<NAKOUTI)) rx_nak_count++;
+	head = rx_head;
+	while (1) {
+		c = UEINTX;
+		if (!(c & (1<<RWAL))) {
+			// no data in buffer
+			if (c & (1<<RXOUTI)) {
+				UEINTX = 0x6B;
+				continue;
+			}
+			break;
+		}
+		space = (rx_tail - head - 1) & RX_BUFFER_MASK;
+		if (!space) {
+			// ring full, leave the rest until usb_serial_read
+			rx_overflow_count++;
+			UEIENX = 0;
+			break;
+		}
+		n = UEBCLX;
+		if (n > space) n = space;
+		while (n--) {
+			rx_buffer[head] = UEDATX;
+			head = (head + 1) & RX_BUFFER_MASK;
+		}
+		// if buffer completely used, release it
+		if (!(UEINTX & (1<<RWAL))) UEINTX = 0x6B;
+	}
+	rx_head = head;
+}
+
+// USB Endpoint Interrupt - endpoint 0 and the receive endpoint are
+// handled here.  The other endpoints are manipulated by the
+// user-callable functions, and the start-of-frame interrupt.
 //
 ISR(USB_COM_vect)
 {
@@ -788,6 +859,10 @@ ISR(USB_COM_vect)
 	const uint8_t *desc_addr;
 	uint8_t	desc_length;
 
+	if (UEINT & (1<<CDC_RX_ENDPOINT)) {
+		usb_serial_rx_endpoint();
+		if (!(UEINT & 1)) return;
+	}
         UENUM = 0;
         intbits = UEINTX;
         if (intbits & (1<<RXSTPI)) {
@@ -865,6 +940,9 @@ ISR(USB_COM_vect)
 			}
         		UERST = 0x1E;
         		UERST = 0;
+			rx_head = rx_tail = 0;
+			UENUM = CDC_RX_ENDPOINT;
+			UEIENX = (1<<RXOUTE);
 			return;
 		}
 		if (bRequest == GET_CONFIGURATION && bmRequestType == 0x80) {
@@ -9,8 +9,11 @@ uint8_t usb_configured(void);		// is the USB port configured
 
 // receiving data
 int16_t usb_serial_getchar(void);	// receive a character (-1 if timeout/error)
+uint8_t usb_serial_read(uint8_t *buffer, uint8_t size); // receive a buffer
 uint8_t usb_serial_available(void);	// number of bytes in receive buffer
 void usb_serial_flush_input(void);	// discard any buffered input
+uint16_t usb_serial_rx_overflows(void);	// times the receive buffer filled
+uint16_t usb_serial_rx_naks(void);	// times the host was NAKed
 
 // transmitting data
 int8_t usb_serial_putchar(uint8_t c);	// transmit a character
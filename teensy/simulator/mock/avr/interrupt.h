@@ -0,0 +1,29 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+/* Interrupt handlers become plain functions which the simulator calls
+   when it raises the matching event */
+extern volatile unsigned char sim_interrupts_enabled;
+
+#define sei() (sim_interrupts_enabled = 1)
+#define cli() (sim_interrupts_enabled = 0)
+
+#define ISR(vector) void vector(void); void vector(void)
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+/* Mocked AVR register layer for host builds of the protocol core
+    - Registers are plain variables owned by the simulator
+    - Every register access is counted in sim_io_accesses for the cycle estimates
+    - NOPs call into the simulator which counts them and watches for ACK pulses */
+#include <stdint.h>
+
+extern unsigned long sim_io_accesses;
+
+void sim_nop(void);
+
+#define SIM_REGISTER(r) (*(sim_io_accesses++, &(r)))
+
+extern volatile uint8_t  sim_CLKPR;
+extern volatile uint8_t  sim_DDRB;
+extern volatile uint8_t  sim_DDRD;
+extern volatile uint8_t  sim_PCICR;
+extern volatile uint8_t  sim_PCMSK0;
+extern volatile uint8_t  sim_PINB;
+extern volatile uint8_t  sim_PORTB;
+extern volatile uint8_t  sim_PORTD;
+extern volatile uint8_t  sim_SPCR;
+extern volatile uint8_t  sim_SPDR;
+extern volatile uint8_t  sim_SPSR;
+extern volatile uint8_t  sim_TCCR1B;
+extern volatile uint16_t sim_TCNT1;
+
+#define CLKPR  SIM_REGISTER(sim_CLKPR)
+#define DDRB   SIM_REGISTER(sim_DDRB)
+#define DDRD   SIM_REGISTER(sim_DDRD)
+#define PCICR  SIM_REGISTER(sim_PCICR)
+#define PCMSK0 SIM_REGISTER(sim_PCMSK0)
+#define PINB   SIM_REGISTER(sim_PINB)
+#define PORTB  SIM_REGISTER(sim_PORTB)
+#define PORTD  SIM_REGISTER(sim_PORTD)
+#define SPCR   SIM_REGISTER(sim_SPCR)
+#define SPDR   SIM_REGISTER(sim_SPDR)
+#define SPSR   SIM_REGISTER(sim_SPSR)
+#define TCCR1B SIM_REGISTER(sim_TCCR1B)
+#define TCNT1  SIM_REGISTER(sim_TCNT1)
+
+/* Bits */
+#define CS10   0
+#define CS12   2
+#define CPHA   2
+#define CPOL   3
+#define DORD   5
+#define SPE    6
+#define SPIE   7
+#define PCIE0  0
+#define PCINT0 0
+
+#define HW_NOP() sim_nop()
+
+/* Set from REPLY_ON_CHANGE_ONLY at build time and switchable at run time (ps2pty -c) */
+extern unsigned char sim_reply_change_only;
+
+#define REPLY_CHANGE_ONLY sim_reply_change_only
+
+#endif
@@ -0,0 +1,664 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Stands in for the Teensy on a pseudo-terminal so ps2bt can run on a Linux host
+    - Usage: ps2pty [options]
+        -l path     Symlink to the pty slave (for example /tmp/ttyACM0)
+        -r hz       Console poll rate, 0 for none (default 60)
+        -s script   Timed console actions, see below
+        -d us       Delay every reply by this long
+        -j us       Add up to this much random delay to every reply
+        -x percent  Drop this percentage of replies
+        -f bytes    Split replies into writes of at most this many bytes
+        -g us       Gap between the pieces of a split reply (default 1000)
+        -c          Only reply when the motors or mode LED change (REPLY_ON_CHANGE_ONLY)
+        -v          Log every packet and reply
+        -w file     Log the left stick X of every packet and analog poll for latency measurement
+    - Packets from ps2bt go through the firmware's packet parser, protocol core and reply
+      path and the console side is played by the simulator, so replies carry real poll timing
+    - The console is multitap aware: while the multitap is presented each poll selects and
+      polls every slot in turn and config actions apply to the pads connected at the time
+    - Script lines are "<ms> <action> [args]" with times from start, # starts a comment
+        poll <hz>               Change the poll rate
+        digital                 Switch to digital mode through config mode (mode LED off)
+        analog                  Switch to analog mode (mode LED on)
+        pressure                Switch to analog mode with pressure buttons (0x79)
+        motors <small> <large>  Motor values sent with each poll (hex)
+        quit                    Print statistics and exit
+    - Wire log lines are "<monotonic seconds> packet|poll <left stick X>"
+        packet                  A packet for slot A from ps2bt was parsed
+        poll                    The console read this value in an analog poll of slot A */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "hardware.h"
+#include "ps2.h"
+#include "sim.h"
+
+#define REPLY_SIZE      8
+#define REPLY_QUEUE     64
+#define SCRIPT_MAX      256
+#define READ_SIZE       256
+
+typedef struct
+{
+    int64_t       due;                /* Time at which the next piece is written */
+    unsigned char data[REPLY_SIZE];
+    unsigned char offset;             /* Bytes already written */
+} pending_reply;
+
+typedef struct
+{
+    int64_t       time;
+    char          action[16];
+    unsigned int  args[2];
+} script_event;
+
+static struct
+{
+    int           master;
+    int64_t       start;
+    
+    /* Options */
+    unsigned int  rate;
+    int64_t       delay;
+    int64_t       jitter;
+    unsigned int  drop;
+    unsigned int  fragment;
+    int64_t       gap;
+    int           verbose;
+    FILE         *wire;
+    
+    /* Console */
+    int64_t       next_poll;
+    unsigned char small_motor;
+    unsigned char large_motor;
+    int           motors_mapped;
+    
+    /* Replies in flight */
+    pending_reply queue[REPLY_QUEUE];
+    unsigned int  queue_head;
+    unsigned int  queue_tail;
+    
+    /* Script */
+    script_event  script[SCRIPT_MAX];
+    unsigned int  script_size;
+    unsigned int  script_next;
+    
+    /* Statistics */
+    unsigned long packets;
+    unsigned long replies;
+    unsigned long dropped;
+    unsigned long skipped;
+    unsigned long polls;
+} pty;
+
+static volatile sig_atomic_t terminate = 0;
+
+static void handle_signal(int sig)
+{
+    (void)sig;
+    terminate = 1;
+}
+
+static int64_t monotonic_time(void)
+{
+    struct timespec t;
+    
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    
+    return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+/* Keep the simulated CPU clock in step with real time so poll timestamps are real */
+static void sync_clock(int64_t now)
+{
+    unsigned long long target;
+    
+    target = (unsigned long long)(now - pty.start) / 1000 * (SIM_CPU_HZ / 1000000);
+    
+    if (target > sim_cycles())
+    {
+        sim_advance(target - sim_cycles());
+    }
+}
+
+static void console_transfer(const unsigned char *in, unsigned char size, unsigned char *out)
+{
+    sim_transaction transaction;
+    
+    sim_transfer(in, size, out, &transaction);
+}
+
+static void log_wire(int64_t now, const char *event, unsigned char lx)
+{
+    fprintf(pty.wire, "%ld.%09ld %s %u\n", (long)(now / 1000000000), (long)(now % 1000000000), event, lx);
+}
+
+/* Returns the number of slots to poll - PACKET_SLOTS while the multitap answers */
+static unsigned char console_slots(void)
+{
+    unsigned char query[] = { 0x21, 0x12, 0x00, 0x00, 0x00, 0x00 };
+    unsigned char out[SIM_TRANSACTION_MAX];
+    
+    console_transfer(query, sizeof(query), out);
+    
+    return (out[1] == 0x80 && out[3] == PACKET_SLOTS) ? PACKET_SLOTS : 1;
+}
+
+static void console_select(unsigned char slot)
+{
+    unsigned char select[] = { 0x21, 0x21, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    unsigned char out[SIM_TRANSACTION_MAX];
+    
+    select[2] = slot;
+    
+    console_transfer(select, sizeof(select), out);
+}
+
+static void console_config_pad(unsigned char mode, unsigned char lock, int pressure)
+{
+    unsigned char enter[]    = { 0x01, 0x43, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    unsigned char set_mode[] = { 0x01, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    unsigned char format[]   = { 0x01, 0x4F, 0x00, 0xFF, 0xFF, 0x03, 0x00, 0x00, 0x00 };
+    unsigned char map[]      = { 0x01, 0x4D, 0x00, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xFF };
+    unsigned char leave[]    = { 0x01, 0x43, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    unsigned char out[SIM_TRANSACTION_MAX];
+    
+    set_mode[3] = mode;
+    set_mode[4] = lock;
+    
+    console_transfer(enter, sizeof(enter), out);
+    
+    if (mode != 0xFF)
+    {
+        console_transfer(set_mode, sizeof(set_mode), out);
+    }
+    
+    if (pressure)
+    {
+        console_transfer(format, sizeof(format), out);
+    }
+    
+    if (!pty.motors_mapped)
+    {
+        console_transfer(map, sizeof(map), out);
+        pty.motors_mapped = 1;
+    }
+    
+    console_transfer(leave, sizeof(leave), out);
+}
+
+static void console_config(unsigned char mode, unsigned char lock, int pressure)
+{
+    unsigned char slots = console_slots();
+    unsigned char slot;
+    int           mapped = pty.motors_mapped;
+    
+    for (slot = 0; slot < slots; slot++)
+    {
+        if (slots > 1)
+        {
+            console_select(slot);
+        }
+        
+        /* Each pad maps its motors on the first config */
+        pty.motors_mapped = mapped;
+        
+        console_config_pad(mode, lock, pressure);
+    }
+}
+
+static void console_poll(int64_t now)
+{
+    unsigned char in[21];
+    unsigned char out[SIM_TRANSACTION_MAX];
+    unsigned char slots = console_slots();
+    unsigned char slot;
+    
+    memset(in, 0, sizeof(in));
+    
+    in[0] = 0x01;
+    in[1] = 0x42;
+    in[3] = pty.small_motor;
+    in[4] = pty.large_motor;
+    
+    for (slot = 0; slot < slots; slot++)
+    {
+        if (slots > 1)
+        {
+            console_select(slot);
+        }
+        
+        console_transfer(in, sizeof(in), out);
+        
+        /* Byte 7 is the left stick X in both analog responses */
+        if (pty.wire && slot == 0 && (out[1] == 0x73 || out[1] == 0x79))
+        {
+            log_wire(now, "poll", out[7]);
+        }
+    }
+    
+    pty.polls++;
+}
+
+/* Responses are composed by the firmware's reply path, which skips unchanged ones with -c */
+static void queue_reply(const sim_reply *reply, int64_t now)
+{
+    pending_reply *pending;
+    int64_t        delay;
+    
+    if (!reply->sent)
+    {
+        pty.skipped++;
+        return;
+    }
+    
+    if (pty.drop && (unsigned int)(rand() % 100) < pty.drop)
+    {
+        pty.dropped++;
+        return;
+    }
+    
+    if (pty.queue_head - pty.queue_tail == REPLY_QUEUE)
+    {
+        pty.dropped++;
+        return;
+    }
+    
+    delay = pty.delay;
+    
+    if (pty.jitter)
+    {
+        delay += (int64_t)(rand() % (int)(pty.jitter / 1000 + 1)) * 1000;
+    }
+    
+    pending = &pty.queue[pty.queue_head++ % REPLY_QUEUE];
+    
+    pending->due = now + delay;
+    pending->offset = 0;
+    memcpy(pending->data, reply->data, REPLY_SIZE);
+}
+
+static void write_replies(int64_t now)
+{
+    while (pty.queue_tail != pty.queue_head)
+    {
+        pending_reply *pending = &pty.queue[pty.queue_tail % REPLY_QUEUE];
+        unsigned int   size;
+        
+        if (pending->due > now)
+        {
+            return;
+        }
+        
+        size = REPLY_SIZE - pending->offset;
+        
+        if (pty.fragment && size > pty.fragment)
+        {
+            size = pty.fragment;
+        }
+        
+        if (write(pty.master, &pending->data[pending->offset], size) != (ssize_t)size)
+        {
+            fprintf(stderr, "ps2pty: write failed: %s\n", strerror(errno));
+        }
+        
+        pending->offset += size;
+        
+        if (pending->offset < REPLY_SIZE)
+        {
+            pending->due = now + pty.gap;
+            return;
+        }
+        
+        if (pty.verbose)
+        {
+            printf("%10.3f reply %02X %02X %02X\n", (double)(now - pty.start) / 1000000.0,
+                   pending->data[1], pending->data[2], pending->data[3]);
+        }
+        
+        pty.replies++;
+        pty.queue_tail++;
+    }
+}
+
+static void run_script(int64_t now)
+{
+    while (pty.script_next < pty.script_size && pty.start + pty.script[pty.script_next].time <= now)
+    {
+        script_event *event = &pty.script[pty.script_next++];
+        
+        if (pty.verbose)
+        {
+            printf("%10.3f %s\n", (double)(now - pty.start) / 1000000.0, event->action);
+        }
+        
+        if (strcmp(event->action, "poll") == 0)
+        {
+            pty.rate = event->args[0];
+            pty.next_poll = now;
+        }
+        else if (strcmp(event->action, "digital") == 0)
+        {
+            console_config(0x00, 0x00, 0);
+        }
+        else if (strcmp(event->action, "analog") == 0)
+        {
+            console_config(0x01, 0x00, 0);
+        }
+        else if (strcmp(event->action, "pressure") == 0)
+        {
+            console_config(0x01, 0x00, 1);
+        }
+        else if (strcmp(event->action, "motors") == 0)
+        {
+            if (!pty.motors_mapped)
+            {
+                console_config(0xFF, 0x00, 0);
+            }
+            
+            pty.small_motor = (unsigned char)event->args[0];
+            pty.large_motor = (unsigned char)event->args[1];
+        }
+        else if (strcmp(event->action, "quit") == 0)
+        {
+            terminate = 1;
+        }
+    }
+}
+
+static int load_script(const char *path)
+{
+    FILE *file;
+    char  line[256];
+    int   number = 0;
+    
+    if ((file = fopen(path, "r")) == NULL)
+    {
+        fprintf(stderr, "ps2pty: cannot open %s\n", path);
+        return -1;
+    }
+    
+    while (fgets(line, sizeof(line), file))
+    {
+        script_event *event;
+        char         *comment;
+        double        time;
+        int           count;
+        
+        number++;
+        
+        if ((comment = strchr(line, '#')) != NULL)
+        {
+            *comment = '\0';
+        }
+        
+        if (pty.script_size == SCRIPT_MAX)
+        {
+            fprintf(stderr, "%s:%d: more than %d events\n", path, number, SCRIPT_MAX);
+            fclose(file);
+            return -1;
+        }
+        
+        event = &pty.script[pty.script_size];
+        event->args[0] = 0;
+        event->args[1] = 0;
+        
+        count = sscanf(line, "%lf %15s %x %x", &time, event->action, &event->args[0], &event->args[1]);
+        
+        if (count <= 0)
+        {
+            continue;
+        }
+        
+        if (count < 2
+        || (strcmp(event->action, "poll") == 0 && sscanf(line, "%*f %*s %u", &event->args[0]) != 1)
+        || (strcmp(event->action, "motors") == 0 && count != 4)
+        || (strcmp(event->action, "poll") && strcmp(event->action, "digital") && strcmp(event->action, "analog")
+         && strcmp(event->action, "pressure") && strcmp(event->action, "motors") && strcmp(event->action, "quit")))
+        {
+            fprintf(stderr, "%s:%d: invalid event\n", path, number);
+            fclose(file);
+            return -1;
+        }
+        
+        event->time = (int64_t)(time * 1000000.0);
+        pty.script_size++;
+    }
+    
+    fclose(file);
+    
+    return 0;
+}
+
+static int open_pty(const char *link)
+{
+    struct termios tty;
+    char          *slave_path;
+    int            slave;
+    
+    if ((pty.master = posix_openpt(O_RDWR | O_NOCTTY)) == -1
+    ||  grantpt(pty.master) == -1
+    ||  unlockpt(pty.master) == -1
+    || (slave_path = ptsname(pty.master)) == NULL)
+    {
+        fprintf(stderr, "ps2pty: cannot create pty: %s\n", strerror(errno));
+        return -1;
+    }
+    
+    /* The slave is held open so the master does not see a hangup between ps2bt runs
+       and is made raw so nothing is echoed before ps2bt configures it */
+    if ((slave = open(slave_path, O_RDWR | O_NOCTTY)) == -1 || tcgetattr(slave, &tty) == -1)
+    {
+        fprintf(stderr, "ps2pty: cannot open %s: %s\n", slave_path, strerror(errno));
+        return -1;
+    }
+    
+    cfmakeraw(&tty);
+    tcsetattr(slave, TCSANOW, &tty);
+    
+    if (link)
+    {
+        unlink(link);
+        
+        if (symlink(slave_path, link) == -1)
+        {
+            fprintf(stderr, "ps2pty: cannot link %s: %s\n", link, strerror(errno));
+            return -1;
+        }
+    }
+    
+    printf("%s\n", link ? link : slave_path);
+    fflush(stdout);
+    
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char    *link = NULL;
+    packet_parser  parser;
+    int            opt;
+    
+    memset(&pty, 0, sizeof(pty));
+    
+    pty.rate = 60;
+    pty.gap = 1000000;
+    
+    while ((opt = getopt(argc, argv, "l:r:s:d:j:x:f:g:cvw:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': link = optarg;                                    break;
+            case 'r': pty.rate = (unsigned int)atoi(optarg);            break;
+            case 's': if (load_script(optarg) == -1) return 1;          break;
+            case 'd': pty.delay = (int64_t)atoi(optarg) * 1000;         break;
+            case 'j': pty.jitter = (int64_t)atoi(optarg) * 1000;        break;
+            case 'x': pty.drop = (unsigned int)atoi(optarg);            break;
+            case 'f': pty.fragment = (unsigned int)atoi(optarg);        break;
+            case 'g': pty.gap = (int64_t)atoi(optarg) * 1000;           break;
+            case 'c': sim_reply_change_only = 1;                        break;
+            case 'v': pty.verbose = 1;                                  break;
+            case 'w':
+                if ((pty.wire = fopen(optarg, "w")) == NULL)
+                {
+                    fprintf(stderr, "ps2pty: cannot open %s: %s\n", optarg, strerror(errno));
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-l link] [-r hz] [-s script] [-d us] [-j us] [-x percent] "
+                                "[-f bytes] [-g us] [-c] [-v] [-w file]\n", argv[0]);
+                return 2;
+        }
+    }
+    
+    if (open_pty(link) == -1)
+    {
+        return 1;
+    }
+    
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    
+    sim_init();
+    packet_parser_reset(&parser);
+    
+    pty.start = monotonic_time();
+    pty.next_poll = pty.start;
+    
+    while (!terminate)
+    {
+        struct pollfd pfd;
+        int64_t       now;
+        int64_t       wake;
+        int           timeout;
+        
+        now = monotonic_time();
+        sync_clock(now);
+        
+        run_script(now);
+        
+        if (pty.rate && now >= pty.next_poll)
+        {
+            console_poll(now);
+            
+            pty.next_poll += 1000000000 / pty.rate;
+            
+            if (pty.next_poll < now) /* Fell behind - do not burst */
+            {
+                pty.next_poll = now + 1000000000 / pty.rate;
+            }
+        }
+        
+        write_replies(now);
+        
+        /* Sleep until the next poll, script event or reply */
+        wake = now + 100000000;
+        
+        if (pty.rate && pty.next_poll < wake)
+        {
+            wake = pty.next_poll;
+        }
+        
+        if (pty.script_next < pty.script_size && pty.start + pty.script[pty.script_next].time < wake)
+        {
+            wake = pty.start + pty.script[pty.script_next].time;
+        }
+        
+        if (pty.queue_tail != pty.queue_head && pty.queue[pty.queue_tail % REPLY_QUEUE].due < wake)
+        {
+            wake = pty.queue[pty.queue_tail % REPLY_QUEUE].due;
+        }
+        
+        timeout = (wake > now) ? (int)((wake - now + 999999) / 1000000) : 0;
+        
+        pfd.fd = pty.master;
+        pfd.events = POLLIN;
+        
+        if (poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN))
+        {
+            unsigned char buffer[READ_SIZE];
+            ssize_t       size;
+            ssize_t       offset;
+            
+            if ((size = read(pty.master, buffer, sizeof(buffer))) <= 0)
+            {
+                continue;
+            }
+            
+            now = monotonic_time();
+            sync_clock(now);
+            
+            /* The parser takes at most one USB transfer's worth at a time */
+            for (offset = 0; offset < size; offset += PACKET_SIZE)
+            {
+                sim_reply     reply;
+                unsigned char chunk;
+                int           count;
+                
+                chunk = (size - offset < PACKET_SIZE) ? (unsigned char)(size - offset) : PACKET_SIZE;
+                
+                if ((count = sim_usb_receive(&parser, &buffer[offset], chunk, &reply)) > 0)
+                {
+                    pty.packets += (unsigned long)count;
+                    
+                    if (pty.verbose)
+                    {
+                        printf("%10.3f packet %02X %02X slot %d mode %02X\n", (double)(now - pty.start) / 1000000.0,
+                               parser.data[0], parser.data[1], reply.slot, controllers[reply.slot].control_mode);
+                    }
+                    
+                    /* Data byte 4 is the left stick X */
+                    if (pty.wire && reply.slot == 0 && reply.result != PACKET_DIAGNOSTICS)
+                    {
+                        log_wire(now, "packet", parser.data[4]);
+                    }
+                    
+                    queue_reply(&reply, now);
+                }
+            }
+            
+            write_replies(now);
+        }
+    }
+    
+    printf("packets %lu replies %lu skipped %lu dropped %lu polls %lu\n",
+           pty.packets, pty.replies, pty.skipped, pty.dropped, pty.polls);
+    
+    if (pty.wire)
+    {
+        fclose(pty.wire);
+    }
+    
+    if (link)
+    {
+        unlink(link);
+    }
+    
+    return 0;
+}
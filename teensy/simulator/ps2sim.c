@@ -0,0 +1,392 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/* Replays PS2 command sequences against the firmware's protocol core
+    - Usage: ps2sim [-q] [-r count] sequence...
+    - Sequence files hold one command per line, # starts a comment
+        update <18 bytes>       USB packet from the Pi with footer 0x55
+        mode <18 bytes>         USB packet with footer 0xAA (mode button pressed)
+        disconnect              USB packet with footer 0x5A
+        diagnostics             USB packet with footer 0x3C (USB receive counters request)
+        counters <ovf> <naks>   USB receive counters reported by the following diagnostics
+        slot <n>                Multitap slot of the following USB packets (0 to 3, default 0)
+        reply <small> <large> <footer>
+                                Expected response to the last USB packet, which must
+                                be for the current slot and answered
+        send <bytes>            Console transaction, starting with the port byte
+        expect <bytes>          Expected controller output for the last transaction,
+                                XX matches any byte
+    - All values are hex
+    - -q only prints failures and the summary, -r replays each file count times */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packet.h"
+#include "sim.h"
+
+#define LINE_MAX_LENGTH 256
+#define TOKENS_MAX      32
+
+typedef struct
+{
+    unsigned long      count;
+    unsigned long long cycles;
+    unsigned long      max_cycles;
+    unsigned long      max_ack_latency;
+} command_stats;
+
+static command_stats stats[17]; /* 0x40-0x4F then everything else */
+static int           quiet = 0;
+
+static double cycles_to_us(unsigned long cycles)
+{
+    return (double)cycles * 1000000.0 / (double)SIM_CPU_HZ;
+}
+
+static int parse_bytes(char **tokens, int count, unsigned char *bytes, unsigned char *wildcard)
+{
+    int i;
+    
+    for (i = 0; i < count; i++)
+    {
+        char          *end;
+        unsigned long  value;
+        
+        if (wildcard && (strcmp(tokens[i], "XX") == 0 || strcmp(tokens[i], "xx") == 0))
+        {
+            bytes[i] = 0x00;
+            wildcard[i] = 1;
+            continue;
+        }
+        
+        value = strtoul(tokens[i], &end, 16);
+        
+        if (*end != '\0' || value > 0xFF)
+        {
+            return -1;
+        }
+        
+        bytes[i] = (unsigned char)value;
+        
+        if (wildcard)
+        {
+            wildcard[i] = 0;
+        }
+    }
+    
+    return 0;
+}
+
+static void record(const sim_transaction *transaction)
+{
+    command_stats *s;
+    
+    s = &stats[((transaction->cmd & 0xF0) == 0x40) ? (transaction->cmd & 0x0F) : 16];
+    
+    s->count++;
+    s->cycles += transaction->cycles;
+    
+    if (transaction->max_cycles > s->max_cycles)
+    {
+        s->max_cycles = transaction->max_cycles;
+    }
+    
+    if (transaction->max_ack_latency > s->max_ack_latency)
+    {
+        s->max_ack_latency = transaction->max_ack_latency;
+    }
+}
+
+static void print_bytes(const unsigned char *bytes, int size)
+{
+    int i;
+    
+    for (i = 0; i < size; i++)
+    {
+        printf(" %02X", bytes[i]);
+    }
+}
+
+/* Returns the number of failed expectations or -1 if the file could not be replayed */
+static int replay(const char *path)
+{
+    FILE            *file;
+    char             line[LINE_MAX_LENGTH];
+    int              number = 0;
+    int              failures = 0;
+    packet_parser    parser;
+    sim_reply        reply;
+    sim_transaction  transaction;
+    unsigned char    out[SIM_TRANSACTION_MAX];
+    unsigned char    slot = 0;
+    
+    if ((file = fopen(path, "r")) == NULL)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+    
+    sim_init();
+    packet_parser_reset(&parser);
+    memset(&reply, 0, sizeof(reply));
+    memset(&transaction, 0, sizeof(transaction));
+    
+    while (fgets(line, sizeof(line), file))
+    {
+        char *tokens[TOKENS_MAX];
+        char *token;
+        char *comment;
+        int   count = 0;
+        
+        number++;
+        
+        if ((comment = strchr(line, '#')) != NULL)
+        {
+            *comment = '\0';
+        }
+        
+        for (token = strtok(line, " \t\r\n"); token && count < TOKENS_MAX; token = strtok(NULL, " \t\r\n"))
+        {
+            tokens[count++] = token;
+        }
+        
+        if (count == 0)
+        {
+            continue;
+        }
+        
+        if (strcmp(tokens[0], "update") == 0 || strcmp(tokens[0], "mode") == 0
+         || strcmp(tokens[0], "disconnect") == 0 || strcmp(tokens[0], "diagnostics") == 0)
+        {
+            unsigned char packet[PACKET_SIZE];
+            unsigned char offset;
+            
+            memset(packet, 0, sizeof(packet));
+            
+            packet[0] = PACKET_HEADER + slot;
+            
+            if (strcmp(tokens[0], "disconnect") == 0)
+            {
+                packet[PACKET_SIZE - 1] = 0x5A;
+            }
+            else if (strcmp(tokens[0], "diagnostics") == 0)
+            {
+                packet[PACKET_SIZE - 1] = PACKET_DIAGNOSTICS_FOOTER;
+            }
+            else
+            {
+                if (count != PACKET_DATA_SIZE + 1 || parse_bytes(&tokens[1], PACKET_DATA_SIZE, &packet[1], NULL))
+                {
+                    fprintf(stderr, "%s:%d: expected %d data bytes\n", path, number, PACKET_DATA_SIZE);
+                    fclose(file);
+                    return -1;
+                }
+                
+                packet[PACKET_SIZE - 1] = (tokens[0][0] == 'm') ? 0xAA : 0x55;
+            }
+            
+            /* Fed in pieces as USB transfers may split a packet */
+            for (offset = 0; offset < PACKET_SIZE; offset += 7)
+            {
+                unsigned char size = (PACKET_SIZE - offset < 7) ? (PACKET_SIZE - offset) : 7;
+                
+                sim_usb_receive(&parser, &packet[offset], size, &reply);
+            }
+        }
+        else if (strcmp(tokens[0], "counters") == 0)
+        {
+            char          *end[2];
+            unsigned long  overflows = 0;
+            unsigned long  naks = 0;
+            
+            if (count == 3)
+            {
+                overflows = strtoul(tokens[1], &end[0], 16);
+                naks = strtoul(tokens[2], &end[1], 16);
+            }
+            
+            if (count != 3 || *end[0] != '\0' || *end[1] != '\0' || overflows > 0xFFFF || naks > 0xFFFF)
+            {
+                fprintf(stderr, "%s:%d: expected two counters from 0 to FFFF\n", path, number);
+                fclose(file);
+                return -1;
+            }
+            
+            sim_usb_counters((unsigned int)overflows, (unsigned int)naks);
+        }
+        else if (strcmp(tokens[0], "slot") == 0)
+        {
+            if (count != 2 || parse_bytes(&tokens[1], 1, &slot, NULL) || slot >= PACKET_SLOTS)
+            {
+                fprintf(stderr, "%s:%d: expected a slot from 0 to %d\n", path, number, PACKET_SLOTS - 1);
+                fclose(file);
+                return -1;
+            }
+        }
+        else if (strcmp(tokens[0], "reply") == 0)
+        {
+            unsigned char expected[3];
+            
+            if (count != 4 || parse_bytes(&tokens[1], 3, expected, NULL))
+            {
+                fprintf(stderr, "%s:%d: expected small motor, large motor and footer\n", path, number);
+                fclose(file);
+                return -1;
+            }
+            
+            if (!reply.sent || reply.small_motor != expected[0] || reply.large_motor != expected[1]
+            ||  reply.footer != expected[2] || reply.slot != slot)
+            {
+                printf("%s:%d: FAIL reply %02X %02X %02X slot %d\n", path, number,
+                       reply.small_motor, reply.large_motor, reply.footer, reply.slot);
+                failures++;
+            }
+        }
+        else if (strcmp(tokens[0], "send") == 0)
+        {
+            unsigned char in[SIM_TRANSACTION_MAX];
+            
+            if (count < 2 || count - 1 > SIM_TRANSACTION_MAX || parse_bytes(&tokens[1], count - 1, in, NULL))
+            {
+                fprintf(stderr, "%s:%d: expected 1 to %d bytes\n", path, number, SIM_TRANSACTION_MAX);
+                fclose(file);
+                return -1;
+            }
+            
+            sim_transfer(in, (unsigned char)(count - 1), out, &transaction);
+            record(&transaction);
+            
+            if (!quiet)
+            {
+                printf("%s:%d: %02X mode %02X %2d bytes %2d acks %5lu cycles (%6.1fus) isr %4lu ack %4lu (%4.1fus)\n",
+                       path, number, transaction.cmd, transaction.mode, transaction.size, transaction.acks,
+                       transaction.cycles, cycles_to_us(transaction.cycles), transaction.max_cycles,
+                       transaction.max_ack_latency, cycles_to_us(transaction.max_ack_latency));
+            }
+        }
+        else if (strcmp(tokens[0], "expect") == 0)
+        {
+            unsigned char expected[SIM_TRANSACTION_MAX];
+            unsigned char wildcard[SIM_TRANSACTION_MAX];
+            int           i;
+            int           match;
+            
+            if (count - 1 > SIM_TRANSACTION_MAX || parse_bytes(&tokens[1], count - 1, expected, wildcard))
+            {
+                fprintf(stderr, "%s:%d: expected up to %d bytes\n", path, number, SIM_TRANSACTION_MAX);
+                fclose(file);
+                return -1;
+            }
+            
+            match = (transaction.size == count - 1);
+            
+            for (i = 0; match && i < count - 1; i++)
+            {
+                match = wildcard[i] || expected[i] == out[i];
+            }
+            
+            if (!match)
+            {
+                printf("%s:%d: FAIL got", path, number);
+                print_bytes(out, transaction.size);
+                printf("\n");
+                failures++;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown command %s\n", path, number, tokens[0]);
+            fclose(file);
+            return -1;
+        }
+    }
+    
+    fclose(file);
+    
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    int repeat = 1;
+    int failures = 0;
+    int i;
+    
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+        {
+            quiet = 1;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-q] [-r count] sequence...\n", argv[0]);
+            return 2;
+        }
+    }
+    
+    if (i == argc)
+    {
+        fprintf(stderr, "usage: %s [-q] [-r count] sequence...\n", argv[0]);
+        return 2;
+    }
+    
+    for (; i < argc; i++)
+    {
+        int r;
+        
+        for (r = 0; r < repeat; r++)
+        {
+            int result;
+            
+            if ((result = replay(argv[i])) == -1)
+            {
+                return 2;
+            }
+            
+            failures += result;
+        }
+    }
+    
+    printf("cmd  count   avg cycles   max isr   max ack (us)\n");
+    
+    for (i = 0; i < 17; i++)
+    {
+        if (stats[i].count)
+        {
+            if (i < 16)
+            {
+                printf("%02X  ", 0x40 | i);
+            }
+            else
+            {
+                printf("--  ");
+            }
+            
+            printf("%6lu %12.1f %9lu %6lu (%4.1f)\n", stats[i].count,
+                   (double)stats[i].cycles / (double)stats[i].count, stats[i].max_cycles,
+                   stats[i].max_ack_latency, cycles_to_us(stats[i].max_ack_latency));
+        }
+    }
+    
+    printf("%d failure%s\n", failures, (failures == 1) ? "" : "s");
+    
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "hardware.h"
+#include "ps2.h"
+#include "reply.h"
+#include "usb_serial.h"
+#include "sim.h"
+
+/* Registers */
+volatile uint8_t  sim_CLKPR;
+volatile uint8_t  sim_DDRB;
+volatile uint8_t  sim_DDRD;
+volatile uint8_t  sim_PCICR;
+volatile uint8_t  sim_PCMSK0;
+volatile uint8_t  sim_PINB;
+volatile uint8_t  sim_PORTB;
+volatile uint8_t  sim_PORTD;
+volatile uint8_t  sim_SPCR;
+volatile uint8_t  sim_SPDR;
+volatile uint8_t  sim_SPSR;
+volatile uint8_t  sim_TCCR1B;
+volatile uint16_t sim_TCNT1;
+
+unsigned long          sim_io_accesses;
+volatile unsigned char sim_interrupts_enabled;
+
+#ifdef REPLY_ON_CHANGE_ONLY
+unsigned char sim_reply_change_only = 1;
+#else
+unsigned char sim_reply_change_only = 0;
+#endif
+
+/* Interrupt handlers in the core */
+void PCINT0_vect(void);
+void SPI_STC_vect(void);
+
+static struct
+{
+    unsigned long long cycles;    /* Cycle clock */
+    unsigned long      nops;      /* NOPs in the current interrupt */
+    unsigned long      io;        /* Register accesses when the current interrupt began */
+    unsigned char      acked;     /* Non-zero once an ACK started in the current interrupt */
+    unsigned long      ack_latency;
+} sim;
+
+/* USB serial as the firmware's reply path sees it
+    - Writes are captured for sim_usb_receive() instead of going to a host
+    - The receive counters are whatever sim_usb_counters() set as there is no receive ring */
+static struct
+{
+    unsigned char response[8];
+    unsigned char written;   /* Bytes captured since the last packet */
+    uint16_t      overflows;
+    uint16_t      naks;
+} sim_usb;
+
+static int sim_ack_asserted(void)
+{
+    #ifdef ACK_SIMULATED_OPEN_COLLECTOR
+        return (sim_DDRB & 0x80) && !(sim_PORTB & 0x80);
+    #else
+        return !(sim_PORTB & 0x80);
+    #endif
+}
+
+void sim_nop(void)
+{
+    sim.nops++;
+    
+    if (!sim.acked && sim_ack_asserted())
+    {
+        sim.acked = 1;
+        sim.ack_latency = SIM_ISR_OVERHEAD_CYCLES / 2 + (sim_io_accesses - sim.io) + sim.nops;
+    }
+}
+
+/* Run an interrupt handler and return its estimated cycles */
+static unsigned long sim_interrupt(void (*handler)(void))
+{
+    unsigned long cycles;
+    
+    sim_TCNT1 = (uint16_t)(sim.cycles >> 10); /* TIMER_CONFIG() prescales by 1024 */
+    
+    sim.nops = 0;
+    sim.io = sim_io_accesses;
+    sim.acked = 0;
+    sim.ack_latency = 0;
+    
+    sim_interrupts_enabled = 0;
+    handler();
+    sim_interrupts_enabled = 1;
+    
+    cycles = SIM_ISR_OVERHEAD_CYCLES + (sim_io_accesses - sim.io) + sim.nops;
+    
+    sim.cycles += cycles;
+    
+    return cycles;
+}
+
+/* Mirrors setup() for the parts the core depends on */
+void sim_init(void)
+{
+    memset(&sim, 0, sizeof(sim));
+    memset(&sim_usb, 0, sizeof(sim_usb));
+    
+    sim_PINB = 0x01;  /* Attn high */
+    sim_DDRB = 0x80;  /* Ack output */
+    sim_PORTB = 0x80; /* Ack high */
+    
+    #ifdef ACK_SIMULATED_OPEN_COLLECTOR
+        sim_DDRB = 0x00;
+        sim_PORTB = 0x00;
+    #endif
+    
+    sim_interrupts_enabled = 1;
+    
+    {
+        unsigned char slot;
+        
+        for (slot = 0; slot < MULTITAP_SLOTS; slot++)
+        {
+            controllers[slot].connected = 0;
+            controllers[slot].poll_timestamp = 0;
+            
+            reset_controller(&controllers[slot]);
+        }
+    }
+    
+    reset_multitap();
+    
+    ignore_transaction();
+    
+    sim_interrupt(PCINT0_vect); /* Attn is high so the next byte begins a transaction */
+}
+
+void sim_advance(unsigned long long cycles)
+{
+    sim.cycles += cycles;
+}
+
+unsigned long long sim_cycles(void)
+{
+    return sim.cycles;
+}
+
+/* Clock one transaction
+    - The console stops clocking when a byte is not acknowledged
+    - out receives what the controller put on MISO for each byte clocked */
+void sim_transfer(const unsigned char *in, unsigned char size, unsigned char *out, sim_transaction *stats)
+{
+    unsigned char i;
+    
+    memset(stats, 0, sizeof(sim_transaction));
+    
+    stats->cmd = (size > 1) ? in[1] : 0x00;
+    
+    sim_PINB &= ~0x01; /* Attn low */
+    stats->cycles += sim_interrupt(PCINT0_vect);
+    
+    for (i = 0; i < size; i++)
+    {
+        unsigned long cycles;
+        
+        out[i] = SPI_OUT_OPERATOR(sim_SPDR);
+        
+        sim_SPDR = in[i];
+        sim.cycles += SIM_BYTE_CYCLES;
+        
+        cycles = sim_interrupt(SPI_STC_vect);
+        
+        stats->size = i + 1;
+        stats->cycles += cycles;
+        
+        if (cycles > stats->max_cycles)
+        {
+            stats->max_cycles = cycles;
+        }
+        
+        if (i == 1)
+        {
+            stats->mode = out[i];
+        }
+        
+        if (!sim.acked)
+        {
+            break;
+        }
+        
+        stats->acks++;
+        
+        if (sim.ack_latency > stats->max_ack_latency)
+        {
+            stats->max_ack_latency = sim.ack_latency;
+        }
+    }
+    
+    sim_PINB |= 0x01; /* Attn high */
+    stats->cycles += sim_interrupt(PCINT0_vect);
+}
+
+int8_t usb_serial_write(const uint8_t *buffer, uint16_t size)
+{
+    uint16_t i;
+    
+    for (i = 0; i < size && sim_usb.written < sizeof(sim_usb.response); i++)
+    {
+        sim_usb.response[sim_usb.written++] = buffer[i];
+    }
+    
+    return 0;
+}
+
+void usb_serial_flush_output(void)
+{
+}
+
+uint16_t usb_serial_rx_overflows(void)
+{
+    return sim_usb.overflows;
+}
+
+uint16_t usb_serial_rx_naks(void)
+{
+    return sim_usb.naks;
+}
+
+void sim_usb_counters(unsigned int overflows, unsigned int naks)
+{
+    sim_usb.overflows = (uint16_t)overflows;
+    sim_usb.naks = (uint16_t)naks;
+}
+
+/* Feed bytes from the Pi through the packet parser
+    - Complete packets go through the firmware's own handle_packet() and send_diagnostics()
+      exactly as main() dispatches them, and the response they write is captured
+    - Returns the number of packets handled - reply describes the last one */
+int sim_usb_receive(packet_parser *parser, const unsigned char *buffer, unsigned char size, sim_reply *reply)
+{
+    unsigned char offset;
+    int           count = 0;
+    
+    for (offset = 0; offset < size;)
+    {
+        unsigned char consumed;
+        unsigned char result;
+        
+        result = packet_parse(parser, &buffer[offset], size - offset, &consumed);
+        
+        offset += consumed;
+        
+        if (result == PACKET_INCOMPLETE)
+        {
+            continue;
+        }
+        
+        sim_TCNT1 = (uint16_t)(sim.cycles >> 10); /* TIMER_READ() when the response is composed */
+        sim_usb.written = 0;
+        
+        if (result == PACKET_DIAGNOSTICS)
+        {
+            send_diagnostics(parser->slot);
+        }
+        else
+        {
+            handle_packet(result, parser->slot, parser->data);
+        }
+        
+        memset(reply, 0, sizeof(sim_reply));
+        
+        reply->result = result;
+        reply->slot = parser->slot;
+        
+        if (sim_usb.written == sizeof(sim_usb.response))
+        {
+            memcpy(reply->data, sim_usb.response, sizeof(reply->data));
+            
+            reply->sent = 1;
+            reply->small_motor = reply->data[1];
+            reply->large_motor = reply->data[2];
+            reply->footer = reply->data[3];
+        }
+        
+        count++;
+    }
+    
+    return count;
+}
@@ -0,0 +1,73 @@
+/*
+ * PS2 Controller Emulator Simulator
+ *
+ * Copyright (C) 2015 Aaron Clovsky <pelvicthrustman@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+/* Host harness around the firmware's protocol core
+    - Plays the console side of the SPI bus and the Pi side of USB
+    - Keeps a cycle clock which drives the mocked timer
+
+   Cycle estimates
+    - SIM_ISR_OVERHEAD_CYCLES covers the vector jump, register saves and reti
+    - One cycle is added per I/O register access and per NOP
+    - C logic between register accesses is not modeled so estimates are lower
+      bounds, useful for comparing firmware changes rather than absolute timing */
+#include "packet.h"
+
+#ifdef USE_8MHZ
+    #define SIM_CPU_HZ 8000000UL
+#else
+    #define SIM_CPU_HZ 16000000UL
+#endif
+
+#define SIM_ISR_OVERHEAD_CYCLES 40
+#define SIM_CONSOLE_CLOCK_HZ    250000UL                                     /* SPI clock used by the console */
+#define SIM_BYTE_CYCLES         (8UL * (SIM_CPU_HZ / SIM_CONSOLE_CLOCK_HZ)) /* One byte on the bus */
+#define SIM_TRANSACTION_MAX     32
+
+typedef struct
+{
+    unsigned char cmd;             /* Command byte sent by the console */
+    unsigned char mode;            /* Mode byte returned by the controller */
+    unsigned char size;            /* Bytes clocked before the controller stopped acknowledging */
+    unsigned char acks;            /* ACK pulses seen */
+    unsigned long cycles;          /* Estimated cycles spent in interrupts */
+    unsigned long max_cycles;      /* Longest single interrupt */
+    unsigned long max_ack_latency; /* Most cycles from interrupt entry to the start of an ACK */
+} sim_transaction;
+
+typedef struct
+{
+    unsigned char result;          /* packet_result of the packet handled */
+    unsigned char slot;            /* Multitap slot of the packet handled */
+    unsigned char sent;            /* Non-zero when the firmware wrote a response to it */
+    unsigned char small_motor;     /* Decoded from data when sent */
+    unsigned char large_motor;
+    unsigned char footer;
+    unsigned char data[8];         /* The response as the firmware wrote it */
+} sim_reply;
+
+void               sim_init(void);
+void               sim_advance(unsigned long long cycles);
+unsigned long long sim_cycles(void);
+void               sim_transfer(const unsigned char *in, unsigned char size, unsigned char *out,
+                                sim_transaction *stats);
+int                sim_usb_receive(packet_parser *parser, const unsigned char *buffer, unsigned char size,
+                                   sim_reply *reply);
+void               sim_usb_counters(unsigned int overflows, unsigned int naks);
+
+#endif